@@ -6,7 +6,7 @@
 #include "api/graphwalker_basic_includes.hpp"
 #include "walks/randomwalkwithstop.hpp"
 
-class graphLet : public RandomWalkwithStop{
+class graphLet final : public StopWalk<graphLet>{
     private:
         vid_t N;
         wid_t *cnt_ok;
@@ -16,18 +16,24 @@ class graphLet : public RandomWalkwithStop{
             N = _N;
             R = _R;
             L = _L;
-            cnt_ok = 0;
+            tid_t nthreads = get_option_int("execthreads", omp_get_max_threads());
+            cnt_ok = new wid_t [nthreads];
+            for(tid_t i = 0; i < nthreads; i++ ){
+                cnt_ok[i] = 0;
+            }
+            registerState(cnt_ok, nthreads*sizeof(wid_t));
             initializeRW(R, L);
         }
 
         void startWalksbyApp(WalkManager &walk_manager){
             // std::cout << "graphLet:\tStart " << R << " walks randomly ..." << std::endl;
-            srand((unsigned)time(NULL));
             tid_t nthreads = get_option_int("execthreads", omp_get_max_threads());
             omp_set_num_threads(nthreads);
+            std::vector<uint32_t> sources(1024);
             // #pragma omp parallel for schedule(static)
                 for (wid_t i = 0; i < R; i++){
-                    vid_t s = rand()%N;
+                    if(i % sources.size() == 0) rng[0].bounded(N, &sources[0], sources.size());
+                    vid_t s = sources[i % sources.size()];
                     bid_t p = getblock(s);
                     vid_t cur = s - blocks[p];
                     //std::cout << "startWalksbyApp:\t" << "source" << i <<"=" << s << "\tp=" << p << "\tcur=" << cur << std::endl;
@@ -36,10 +42,6 @@ class graphLet : public RandomWalkwithStop{
                     walk_manager.minstep[p] = 0;
                     walk_manager.walknum[p]++;
                 }
-            cnt_ok = new wid_t [nthreads];
-            for(tid_t i = 0; i < nthreads; i++ ){
-                cnt_ok[i] = 0;
-            }
             walk_manager.walksum = R;
         }
 
@@ -9,7 +9,7 @@
 #include "util/toplist.hpp"
 #include "util/comperror.hpp"
 
-class KK_PPR : public RandomWalkwithProb{
+class KK_PPR final : public ProbWalk<KK_PPR>{
 public:
     vid_t firstsource, numsources;
     wid_t walkspersource;
@@ -36,6 +36,7 @@ public:
         for(int i=0; i<exec_threads; i++){
             used_edges[i] = 0;
         }
+        registerState(used_edges, exec_threads*sizeof(eid_t));
     }
 
     void startWalksbyApp(WalkManager &walk_manager){
@@ -9,7 +9,7 @@
 #include "util/toplist.hpp"
 #include "util/comperror.hpp"
 
-class MultiSourcePersonalizedPageRank : public RandomWalkwithStop{
+class MultiSourcePersonalizedPageRank final : public StopWalk<MultiSourcePersonalizedPageRank>{
 public:
     vid_t firstsource, numsources;
     wid_t walkspersource;
@@ -30,12 +30,18 @@ public:
         initializeRW(numsources*walkspersource, maxwalklength);
         visitfrequencies = new DiscreteDistribution[numsources];
         logstream(LOG_INFO) << "Successfully allocate visitfrequencies memory for each each source, with numsources = " << numsources << std::endl;
+        for(vid_t i = 0; i < numsources; i++){
+            registerState(&visitfrequencies[i].size, sizeof(unsigned));
+            registerState(visitfrequencies[i].ids, capacity*sizeof(vid_t));
+            registerState(visitfrequencies[i].counts, capacity*sizeof(uint16_t));
+        }
 
         exec_threads = get_option_int("execthreads", omp_get_max_threads());
         used_edges = new eid_t[exec_threads];
         for(int i=0; i<exec_threads; i++){
             used_edges[i] = 0;
         }
+        registerState(used_edges, exec_threads*sizeof(eid_t));
     }
 
     void startWalksbyApp(WalkManager &walk_manager){
@@ -0,0 +1,156 @@
+#include <string>
+#include <fstream>
+#include <cmath>
+#include <sys/mman.h>
+
+#include "api/graphwalker_basic_includes.hpp"
+#include "walks/node2vecwalk.hpp"
+
+typedef unsigned VertexDataType;
+
+/**
+ * node2vec walks from every vertex, R each of L steps. With option output the
+ * walks are written there, one per line, as the corpus of an embedding;
+ * otherwise only the visits of each vertex are counted. Build with
+ * WALK_RECORD=160.
+ *
+ * The steps are stored, until the walks are done, in the file output.steps
+ * mapped shared: N*R*L vertex ids plus one, 0 past the end of a walk, so
+ * the kernel writes them back instead of the corpus taking memory. A
+ * resumed run keeps the file, the steps taken again after the checkpoint
+ * overwrite theirs.
+ */
+class Node2vec : public Node2vecWalk{
+public:
+    VertexDataType *vertex_value;
+    vid_t *corpus; //vertex+1 of each step of each walk, mapped from corpusfile with option output
+    size_t corpus_sz;
+    std::string corpusfile;
+    bool corpus_kept; //of an earlier run, to resume
+
+public:
+
+    void initializeApp( vid_t _N, wid_t _R, hid_t _L, float _p, float _q, std::string output ){
+        initializeRW(_N, _R, _L, _p, _q);
+        if((uint64_t)N*R > 0xffffffffULL){
+            logstream(LOG_FATAL) << "N*R = " << (uint64_t)N*R << " walks do not fit the 32 bit walk id." << std::endl;
+            assert(false);
+        }
+        vertex_value = new VertexDataType[N];
+        for(vid_t i = 0; i < N; i++){
+            vertex_value[i] = 0;
+        }
+        registerState(vertex_value, N*sizeof(VertexDataType));
+        corpus = NULL;
+        if(output != "") openCorpus(output + ".steps");
+    }
+
+    ~Node2vec(){
+        delete [] vertex_value;
+        if(corpus != NULL) munmap(corpus, corpus_sz);
+    }
+
+    /* map the step file, new and all zero unless the run may resume */
+    void openCorpus(std::string fname){
+        corpusfile = fname;
+        corpus_sz = (size_t)N*R*L*sizeof(vid_t);
+        corpus_kept = get_option_int("resume", 0) != 0;
+        int f = open(corpusfile.c_str(), O_RDWR | O_CREAT | (corpus_kept ? 0 : O_TRUNC), S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+        if(f < 0 || ftruncate(f, corpus_sz) != 0){
+            logstream(LOG_FATAL) << "Could not create " << corpusfile << ": " << strerror(errno) << std::endl;
+            assert(false);
+        }
+        corpus = (vid_t*)mmap(NULL, corpus_sz > 0 ? corpus_sz : 1, PROT_READ | PROT_WRITE, MAP_SHARED, f, 0);
+        if(corpus == MAP_FAILED){
+            logstream(LOG_FATAL) << "Could not map " << corpusfile << ": " << strerror(errno) << std::endl;
+            assert(false);
+        }
+        close(f);
+        madvise_range(corpus, corpus_sz, MADV_RANDOM);
+    }
+
+    void startWalksbyApp( WalkManager &walk_manager  ){
+        logstream(LOG_INFO) << "Start node2vec walks ! Total walk number = " << R*N << ", p = " << p << ", q = " << q << std::endl;
+        tid_t nthreads = get_option_int("execthreads", omp_get_max_threads());
+        omp_set_num_threads(nthreads);
+        if(corpus != NULL && corpus_kept) memset(corpus, 0, corpus_sz); //no checkpoint to resume from after all
+        #pragma omp parallel for schedule(static)
+            for( bid_t b = 0; b < nblocks; b++ ){
+                walk_manager.minstep[b] = 0;
+                walk_manager.walknum[b] = (blocks[b+1]-blocks[b])*R;
+                for( vid_t v = blocks[b]; v < blocks[b+1]; v++ ){
+                    vid_t cur = v - blocks[b];
+                    for( wid_t j = 0; j < R; j++ ){
+                        WalkDataType walk = walk_manager.encode(v, cur, 0, v*R + j);
+                        walk_manager.moveWalk(walk,b,omp_get_thread_num(),cur);
+                    }
+                }
+            }
+        walk_manager.walksum = R*N;
+    }
+
+    void updateStep(uint32_t walkId, vid_t s, vid_t dstId, tid_t threadid, hid_t hop){
+        assert(dstId < N);
+        __sync_fetch_and_add(&vertex_value[dstId], 1);
+        if(corpus != NULL) corpus[(size_t)walkId*L + hop] = dstId + 1;
+    }
+
+    /* the walks as text, from the step file, which is removed after */
+    void writeCorpus(std::string fname){
+        madvise_range(corpus, corpus_sz, MADV_SEQUENTIAL);
+        std::ofstream out(fname.c_str());
+        for(size_t w = 0; w < (size_t)N*R; w++){
+            for(hid_t h = 0; h < L && corpus[w*L + h] != 0; h++)
+                out << (h > 0 ? " " : "") << corpus[w*L + h] - 1;
+            out << "\n";
+        }
+        out.close();
+        munmap(corpus, corpus_sz);
+        corpus = NULL;
+        unlink(corpusfile.c_str());
+    }
+
+};
+
+
+int main(int argc, const char ** argv) {
+    /* GraphChi initialization will read the command line
+     arguments and the configuration file. */
+    set_argc(argc, argv);
+
+    /* Metrics object for keeping track of performance count_invectorers
+     and other information. Currently required. */
+    metrics m("node2vec");
+
+    /* Basic arguments for application */
+    std::string filename = get_option_string("file", "../dataset/LiveJournal/soc-LiveJournal1.txt");  // Base filename
+    unsigned N = get_option_int("N", 4847571); // Number of vertices
+    unsigned R = get_option_int("R", 10); // Number of walks per vertex
+    unsigned L = get_option_int("L", 80); // Number of steps per walk
+    float p = get_option_float("p", 1); // return parameter
+    float q = get_option_float("q", 1); // in-out parameter
+    std::string output = get_option_string("output", ""); // file of the walks, one per line
+    float prob = get_option_float("prob", 0.2); // prob of chose min step
+    unsigned long long blocksize_kb = get_option_long("blocksize_kb", 0); // Size of block, represented in KB
+    bid_t nmblocks = get_option_int("nmblocks", 0); // number of in-memory blocks
+    if(get_option_int("bloom_bits", 0) == 0) set_conf("bloom_bits", "8"); // neighbor Bloom filters, on by default for second order walks
+
+    /* Run */
+    Node2vec program;
+    program.initializeApp( N, R, L, p, q, output );
+
+    if(blocksize_kb == 0)
+        blocksize_kb = program.compBlockSize(N*R);
+    /* Detect the number of shards or preprocess an input to create them */
+    bid_t nblocks = convert_if_notexists(filename, blocksize_kb);
+    if(nmblocks == 0) nmblocks = program.compNmblocks(blocksize_kb);
+    if(nmblocks > nblocks) nmblocks = nblocks;
+
+    graphwalker_engine engine(filename, blocksize_kb, nblocks,nmblocks, m);
+    engine.run(program, prob);
+    if(output != "") program.writeCorpus(output);
+
+    /* Report execution metrics */
+    metrics_report(m);
+    return 0;
+}
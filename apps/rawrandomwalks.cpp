@@ -7,7 +7,7 @@
 #include "api/graphwalker_basic_includes.hpp"
 #include "walks/randomwalkwithjump.hpp"
 
-class RawRandomWalks : public RandomWalkwithJump{
+class RawRandomWalks final : public JumpWalk<RawRandomWalks>{
 
 public:
 
@@ -26,12 +26,11 @@ public:
 
     void startWalksbyApp(WalkManager &walk_manager){
         std::cout << "Random walks:\tStart " << R << " walks randomly ..." << std::endl;
-        srand((unsigned)time(NULL));
         tid_t exec_threads = get_option_int("execthreads", omp_get_max_threads());
         omp_set_num_threads(exec_threads);
         #pragma omp parallel for schedule(static)
             for (wid_t i = 0; i < R; i++){
-                vid_t s = rand()%N;
+                vid_t s = rng[omp_get_thread_num()].bounded(N);
                 bid_t p = getblock(s);
                 vid_t cur = s - blocks[p];
                 // std::cout << "startWalksbyApp:\t" << "source " << i <<" = " << s << "\tp=" << p << "\tcur=" << cur << std::endl;
@@ -40,9 +39,7 @@ public:
                 // walk_manager.pwalks[omp_get_thread_num()][p].push_back(walk);
             }
         for( bid_t p = 0; p < nblocks; p++){
-            walk_manager.walknum[p] = walk_manager.dwalknum[p];
-            for(tid_t t = 0; t < exec_threads; t++)
-                walk_manager.walknum[p] +=  walk_manager.pwalks[t][p].size_w;
+            walk_manager.walknum[p] = walk_manager.stagedWalks(p);
             if(walk_manager.walknum[p] )
                 walk_manager.minstep[p] = 0;
         }
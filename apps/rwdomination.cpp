@@ -10,7 +10,7 @@
 
 typedef unsigned VertexDataType;
 
-class RandomWalkDomination : public RandomWalkwithJump{
+class RandomWalkDomination final : public JumpWalk<RandomWalkDomination>{
 public:
     VertexDataType *vertex_value;
     std::string basefilename;
@@ -34,6 +34,7 @@ public:
         for(vid_t i = 0; i < N; i++){
             vertex_value[i] = 0;
         }
+        registerState(vertex_value, N*sizeof(VertexDataType));
         // initialVertexValue<VertexDataType>(N, basefilename);
         initializeRW( N, R, L);
     }
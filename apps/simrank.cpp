@@ -6,7 +6,7 @@
 #include "api/graphwalker_basic_includes.hpp"
 #include "walks/randomwalkwithrestartwithjoint.hpp"
 
-class SimRank : public RandomWalkwithRestartwithJoint{
+class SimRank final : public JointWalk<SimRank>{
 private:
 	vid_t a, b;
 	std::vector<vid_t> walksfroma; //record the path of walks
@@ -24,6 +24,8 @@ public:
 		walksfromb.resize(R*L);
 		memset(walksfroma.data(), 0xff, walksfroma.size()*sizeof(vid_t));
 		memset(walksfromb.data(), 0xff, walksfromb.size()*sizeof(vid_t));
+		registerState(walksfroma.data(), walksfroma.size()*sizeof(vid_t));
+		registerState(walksfromb.data(), walksfromb.size()*sizeof(vid_t));
 		initializeRW( R, L);
 	}
 
@@ -0,0 +1,115 @@
+#ifndef DEF_GRAPHWALKER_BLOCKINDEX
+#define DEF_GRAPHWALKER_BLOCKINDEX
+
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "api/datatype.hpp"
+#include "api/io.hpp"
+#include "logger/logger.hpp"
+
+#define BLOCK_INDEX_MAGIC 0x5844494b4c425747ULL // "GWBLKIDX"
+#define BLOCK_INDEX_VERSION 1
+
+/**
+ * Binary block index, blocksize_<N>KB.blockindex. The header is followed by
+ * eid_t edge offset[nblocks+1] (beg_pos of each block's first vertex),
+ * uint64_t byte size[nblocks] (its beg_pos and csr bytes) and vid_t first
+ * vertex[nblocks+1], so the whole file can be mapped and used in place.
+ */
+struct block_index_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t nblocks;
+    uint64_t nvertices;
+    uint64_t nedges;
+    uint64_t reserved[3];
+};
+
+static void write_block_index(std::string fname, const std::vector<vid_t> &blocks, const std::vector<eid_t> &offs) {
+    block_index_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = BLOCK_INDEX_MAGIC;
+    hdr.version = BLOCK_INDEX_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.nblocks = blocks.size() - 1;
+    hdr.nvertices = blocks.back();
+    hdr.nedges = offs.back() - offs[0];
+    std::vector<uint64_t> nbytes(hdr.nblocks);
+    for (uint64_t p = 0; p < hdr.nblocks; p++)
+        nbytes[p] = (uint64_t)(blocks[p+1] - blocks[p] + 1) * sizeof(eid_t) + (offs[p+1] - offs[p]) * sizeof(vid_t);
+
+    int f = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+    if (f < 0) {
+        logstream(LOG_FATAL) << "Could not open " << fname << " error: " << strerror(errno) << std::endl;
+    }
+    assert(f >= 0);
+    size_t off = 0;
+    pwritea(f, (char*)&hdr, sizeof(hdr), off);
+    off += sizeof(hdr);
+    pwritea(f, (char*)&offs[0], offs.size() * sizeof(eid_t), off);
+    off += offs.size() * sizeof(eid_t);
+    if (hdr.nblocks > 0) pwritea(f, (char*)&nbytes[0], nbytes.size() * sizeof(uint64_t), off);
+    off += nbytes.size() * sizeof(uint64_t);
+    pwritea(f, (char*)&blocks[0], blocks.size() * sizeof(vid_t), off);
+    close(f);
+}
+
+/**
+ * Read only mapping of a block index.
+ */
+class block_index {
+    void *map;
+    size_t map_sz;
+
+public:
+    block_index_header *hdr;
+    eid_t *offs;
+    uint64_t *nbytes;
+    vid_t *blocks;
+
+    block_index() : map(NULL), map_sz(0), hdr(NULL), offs(NULL), nbytes(NULL), blocks(NULL) {}
+
+    ~block_index() {
+        if (map != NULL) munmap(map, map_sz);
+    }
+
+    /* false if fname is missing or not a block index of this version */
+    bool open(std::string fname) {
+        int f = ::open(fname.c_str(), O_RDONLY);
+        if (f < 0) return false;
+        map_sz = lseek(f, 0, SEEK_END);
+        if (map_sz < sizeof(block_index_header)) {
+            ::close(f);
+            return false;
+        }
+        map = mmap(NULL, map_sz, PROT_READ, MAP_SHARED, f, 0);
+        ::close(f);
+        if (map == MAP_FAILED) {
+            map = NULL;
+            return false;
+        }
+        hdr = (block_index_header*)map;
+        size_t need = hdr->header_size + (hdr->nblocks + 1) * (sizeof(eid_t) + sizeof(vid_t)) + hdr->nblocks * sizeof(uint64_t);
+        if (hdr->magic != BLOCK_INDEX_MAGIC || hdr->version != BLOCK_INDEX_VERSION || map_sz < need) {
+            logstream(LOG_WARNING) << "Ignore block index " << fname << " of another version." << std::endl;
+            munmap(map, map_sz);
+            map = NULL;
+            hdr = NULL;
+            return false;
+        }
+        offs = (eid_t*)((char*)map + hdr->header_size);
+        nbytes = (uint64_t*)(offs + hdr->nblocks + 1);
+        blocks = (vid_t*)(nbytes + hdr->nblocks);
+        return true;
+    }
+};
+
+#endif
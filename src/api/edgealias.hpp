@@ -0,0 +1,58 @@
+#ifndef DEF_GRAPHWALKER_EDGEALIAS
+#define DEF_GRAPHWALKER_EDGEALIAS
+
+#include <vector>
+#include <stdint.h>
+
+#include "api/datatype.hpp"
+
+/**
+ * Alias table entry of an edge, for walks by edge weight. file_0.alias holds
+ * one per edge, at the edge's position in the csr, so the table of a vertex
+ * is its out edges' entries and a block's tables are its csr range. A step
+ * draws a uniform edge i and keeps it with chance prob/2^32, else takes edge
+ * alias of the same vertex, which is O(1) whatever the degree.
+ */
+struct alias_entry {
+    uint32_t prob; //walk_rng::chance threshold, 0xffffffff for certain
+    vid_t alias; //index of the other edge among the vertex's out edges
+};
+
+/**
+ * Vose's alias method over the n weights w of a vertex's out edges, into
+ * tab. Negative weights count as 0, all zero weights as uniform. A full
+ * column is its own alias, so the few draws its rounded prob misses still
+ * land on it.
+ */
+static void build_alias(const float *w, eid_t n, alias_entry *tab) {
+    double sum = 0;
+    for (eid_t i = 0; i < n; i++) if (w[i] > 0) sum += w[i];
+    std::vector<double> p(n);
+    std::vector<eid_t> small, large;
+    for (eid_t i = 0; i < n; i++) {
+        p[i] = sum > 0 ? (w[i] > 0 ? w[i] : 0) * n / sum : 1;
+        if (p[i] < 1) small.push_back(i);
+        else large.push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        eid_t s = small.back(), l = large.back();
+        small.pop_back();
+        tab[s].prob = (uint32_t)(p[s] * 4294967296.0);
+        tab[s].alias = (vid_t)l;
+        p[l] -= 1 - p[s];
+        if (p[l] < 1) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    for (size_t i = 0; i < large.size(); i++) {
+        tab[large[i]].prob = 0xffffffff;
+        tab[large[i]].alias = (vid_t)large[i];
+    }
+    for (size_t i = 0; i < small.size(); i++) { //left over from rounding
+        tab[small[i]].prob = 0xffffffff;
+        tab[small[i]].alias = (vid_t)small[i];
+    }
+}
+
+#endif
@@ -21,11 +21,23 @@ static std::string fidname( std::string basefilename, bid_t p ){
     return ss.str();
 }
 
-static std::string walksname( std::string basefilename, bid_t p ){
+/**
+ * Spill file of the walks of all blocks.
+ */
+static std::string walkspillname( std::string basefilename ){
     std::stringstream ss;
     ss << basefilename;
-    ss << "_GraphWalker/walks/pool";
-    ss << "_" << p << ".walks";
+    ss << "_GraphWalker/walks/spill.walks";
+    return ss.str();
+}
+
+/**
+ * Checkpoint of the walks in the spill file.
+ */
+static std::string walkcheckpointname( std::string basefilename ){
+    std::stringstream ss;
+    ss << basefilename;
+    ss << "_GraphWalker/walks/checkpoint";
     return ss.str();
 }
 
@@ -36,10 +48,40 @@ static std::string filerangename(std::string basefilename, uint16_t filesize_GB)
     return ss.str();
 }
 
-static std::string blockrangename(std::string basefilename, unsigned long long blocksize_KB){
+static std::string blockindexname(std::string basefilename, unsigned long long blocksize_KB){
+    std::stringstream ss;
+    ss << basefilename;
+    ss << "_GraphWalker/blocksize_" << blocksize_KB << "KB.blockindex";
+    return ss.str();
+}
+
+/**
+ * Byte offsets of the blocks in the compressed csr (file_0.vcsr).
+ */
+static std::string vcsrindexname(std::string basefilename, unsigned long long blocksize_KB){
+    std::stringstream ss;
+    ss << basefilename;
+    ss << "_GraphWalker/blocksize_" << blocksize_KB << "KB.vcsrindex";
+    return ss.str();
+}
+
+/**
+ * Adjacency of the highest degree vertices within hotcache_KB.
+ */
+static std::string hotverticesname(std::string basefilename, unsigned long long hotcache_KB){
+    std::stringstream ss;
+    ss << basefilename;
+    ss << "_GraphWalker/hotcache_" << hotcache_KB << "KB.hotvertices";
+    return ss.str();
+}
+
+/**
+ * Neighbor Bloom filters of the blocks, bits_per_edge bits per edge.
+ */
+static std::string neighborbloomname(std::string basefilename, unsigned long long blocksize_KB, unsigned bits_per_edge){
     std::stringstream ss;
     ss << basefilename;
-    ss << "_GraphWalker/blocksize_" << blocksize_KB << "KB.blockrange";
+    ss << "_GraphWalker/blocksize_" << blocksize_KB << "KB_" << bits_per_edge << "b.nbrbloom";
     return ss.str();
 }
 
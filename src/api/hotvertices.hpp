@@ -0,0 +1,137 @@
+#ifndef DEF_GRAPHWALKER_HOTVERTICES
+#define DEF_GRAPHWALKER_HOTVERTICES
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "api/datatype.hpp"
+#include "api/io.hpp"
+#include "logger/logger.hpp"
+
+#define HOT_VERTICES_MAGIC 0x544f485845545647ULL // "GVTEXHOT"
+#define HOT_VERTICES_VERSION 1
+
+/**
+ * Hot vertex store, hotcache_<N>KB.hotvertices: the adjacency of the highest
+ * degree vertices that fit in the budget. The header is followed by vid_t
+ * vertex[nhot] in ascending order, eid_t offset[nhot+1] into the edges and
+ * vid_t edge[nedges].
+ */
+struct hot_vertices_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t nhot;
+    uint64_t nedges;
+    uint64_t nvertices; //of the graph, bounds the membership bitmap
+    uint64_t reserved[3];
+};
+
+static void write_hot_vertices(std::string fname, vid_t nvertices, const std::vector<vid_t> &ids, const std::vector<eid_t> &offs, const std::vector<vid_t> &adj) {
+    hot_vertices_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = HOT_VERTICES_MAGIC;
+    hdr.version = HOT_VERTICES_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.nhot = ids.size();
+    hdr.nedges = adj.size();
+    hdr.nvertices = nvertices;
+
+    int f = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+    if (f < 0) {
+        logstream(LOG_FATAL) << "Could not open " << fname << " error: " << strerror(errno) << std::endl;
+    }
+    assert(f >= 0);
+    size_t off = 0;
+    pwritea(f, (char*)&hdr, sizeof(hdr), off);
+    off += sizeof(hdr);
+    if (!ids.empty()) pwritea(f, (char*)&ids[0], ids.size() * sizeof(vid_t), off);
+    off += ids.size() * sizeof(vid_t);
+    pwritea(f, (char*)&offs[0], offs.size() * sizeof(eid_t), off);
+    off += offs.size() * sizeof(eid_t);
+    if (!adj.empty()) pwritea(f, (char*)&adj[0], adj.size() * sizeof(vid_t), off);
+    close(f);
+}
+
+/**
+ * Resident mapping of a hot vertex store. The file is populated and locked
+ * in memory at open, so lookups never fault; a bitmap over all vertices
+ * keeps the miss path to a single bit test.
+ */
+class hot_vertices {
+    void *map;
+    size_t map_sz;
+    uint64_t *bits;
+
+public:
+    hot_vertices_header *hdr;
+    vid_t *ids;
+    eid_t *offs;
+    vid_t *adj;
+
+    hot_vertices() : map(NULL), map_sz(0), bits(NULL), hdr(NULL), ids(NULL), offs(NULL), adj(NULL) {}
+
+    ~hot_vertices() {
+        if (map != NULL) munmap(map, map_sz);
+        if (bits != NULL) free(bits);
+    }
+
+    /* false if fname is missing or not a hot vertex store of this version */
+    bool open(std::string fname) {
+        int f = ::open(fname.c_str(), O_RDONLY);
+        if (f < 0) return false;
+        map_sz = lseek(f, 0, SEEK_END);
+        if (map_sz < sizeof(hot_vertices_header)) {
+            ::close(f);
+            return false;
+        }
+        map = mmap(NULL, map_sz, PROT_READ, MAP_SHARED | MAP_POPULATE, f, 0);
+        ::close(f);
+        if (map == MAP_FAILED) {
+            map = NULL;
+            return false;
+        }
+        hdr = (hot_vertices_header*)map;
+        size_t need = hdr->header_size + hdr->nhot * sizeof(vid_t) + (hdr->nhot + 1) * sizeof(eid_t) + hdr->nedges * sizeof(vid_t);
+        if (hdr->magic != HOT_VERTICES_MAGIC || hdr->version != HOT_VERTICES_VERSION || map_sz < need) {
+            logstream(LOG_WARNING) << "Ignore hot vertex store " << fname << " of another version." << std::endl;
+            munmap(map, map_sz);
+            map = NULL;
+            hdr = NULL;
+            return false;
+        }
+        if (mlock(map, map_sz) != 0) {
+            logstream(LOG_WARNING) << "Could not lock the hot vertex store in memory: " << strerror(errno) << std::endl;
+        }
+        ids = (vid_t*)((char*)map + hdr->header_size);
+        offs = (eid_t*)(ids + hdr->nhot);
+        adj = (vid_t*)(offs + hdr->nhot + 1);
+        size_t nwords = (hdr->nvertices + 63) / 64;
+        bits = (uint64_t*)calloc(nwords > 0 ? nwords : 1, sizeof(uint64_t));
+        for (uint64_t i = 0; i < hdr->nhot; i++)
+            bits[ids[i] >> 6] |= 1ULL << (ids[i] & 63);
+        return true;
+    }
+
+    uint64_t size() {
+        return hdr == NULL ? 0 : hdr->nhot;
+    }
+
+    /* out edges of v if it is hot */
+    bool find(vid_t v, vid_t *&edges, eid_t &outd) {
+        if (v >= hdr->nvertices || !((bits[v >> 6] >> (v & 63)) & 1)) return false;
+        uint64_t i = std::lower_bound(ids, ids + hdr->nhot, v) - ids;
+        edges = adj + offs[i];
+        outd = offs[i+1] - offs[i];
+        return true;
+    }
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <zlib.h>
+#include <sys/mman.h>
 
 template <typename T>
 void preada(int f, T * tbuf, size_t nbytes, size_t off = 0) {
@@ -52,6 +53,26 @@ void pwritea(int f, T * tbuf, size_t nbytes, size_t off = 0) {
     }  
 }
 
+/**
+ * madvise for a range that need not start on a page boundary. The pages it
+ * touches are advised, except for MADV_DONTNEED: only the pages wholly
+ * inside are dropped, the ones it shares with its neighbours stay.
+ */
+static inline void madvise_range(void *addr, size_t nbytes, int advice) {
+    if (nbytes == 0) return;
+    size_t pagesz = sysconf(_SC_PAGESIZE);
+    size_t st = (size_t)addr & ~(pagesz - 1);
+    size_t en = (size_t)addr + nbytes;
+    if (advice == MADV_DONTNEED) {
+        st = ((size_t)addr + pagesz - 1) & ~(pagesz - 1);
+        en &= ~(pagesz - 1);
+        if (en <= st) return;
+    }
+    if (madvise((void*)st, en - st, advice) != 0) {
+        logstream(LOG_WARNING) << "madvise(" << advice << ") failed: " << strerror(errno) << std::endl;
+    }
+}
+
 template <typename T>
 void writefile(std::string fname, T * buf, T * &bufptr){
     int f = open(fname.c_str(), O_WRONLY | O_CREAT, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
@@ -0,0 +1,311 @@
+#ifndef DEF_IOBACKEND_HPP
+#define DEF_IOBACKEND_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "logger/logger.hpp"
+#include "api/io.hpp"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define GRAPHWALKER_HAS_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#define IO_CHUNK_SIZE 1024 * 1024 // large requests are split so the device sees several at once
+#define IO_QUEUE_DEPTH 64
+#define DIRECT_IO_ALIGN 4096 // offset, length and buffer alignment of O_DIRECT reads
+
+/**
+ * Pluggable backend for block and walk pool I/O. Requests are queued with
+ * queue_read/queue_write and are only guaranteed to be done after submit().
+ * A backend instance must only be used by one thread at a time.
+ */
+class io_backend {
+public:
+    virtual ~io_backend() {}
+
+    virtual std::string name() = 0;
+
+    /* fds registered here may be used without per-request file lookups */
+    virtual void register_files(const std::vector<int> &fds) {}
+
+    /* buffers registered here are pinned once instead of on every request */
+    virtual void register_buffers(const std::vector<struct iovec> &bufs) {}
+
+    virtual void queue_read(int f, void *buf, size_t nbytes, size_t off) = 0;
+    virtual void queue_write(int f, const void *buf, size_t nbytes, size_t off) = 0;
+
+    /* submit all queued requests and wait for them to complete */
+    virtual void submit() = 0;
+
+    void read(int f, void *buf, size_t nbytes, size_t off) {
+        queue_read(f, buf, nbytes, off);
+        submit();
+    }
+
+    void write(int f, const void *buf, size_t nbytes, size_t off) {
+        queue_write(f, buf, nbytes, off);
+        submit();
+    }
+};
+
+/**
+ * The plain pread/pwrite path, every request is done as soon as it is queued.
+ */
+class sync_io_backend : public io_backend {
+public:
+    std::string name() { return "sync"; }
+
+    void queue_read(int f, void *buf, size_t nbytes, size_t off) {
+        preada(f, (char*)buf, nbytes, off);
+    }
+
+    void queue_write(int f, const void *buf, size_t nbytes, size_t off) {
+        pwritea(f, (char*)buf, nbytes, off);
+    }
+
+    void submit() {}
+};
+
+#ifdef GRAPHWALKER_HAS_URING
+
+/**
+ * io_uring backend on the raw syscalls, so there is no liburing dependency.
+ * Queued requests are split into IO_CHUNK_SIZE pieces and submitted in
+ * batches of up to IO_QUEUE_DEPTH with a single io_uring_enter. Registered
+ * files and buffers are used automatically when a request matches them.
+ */
+class uring_io_backend : public io_backend {
+    struct io_request {
+        int f;
+        char *buf;
+        size_t nbytes;
+        size_t off;
+        bool write;
+    };
+
+    int ring_fd;
+    unsigned depth;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_sz, cq_sz;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+
+    std::vector<int> fixed_files;
+    std::vector<struct iovec> fixed_bufs;
+    std::deque<io_request> pending;
+    std::vector<io_request> inflight; //indexed by user_data
+    std::vector<unsigned> freeslots;
+
+public:
+    bool ok;
+
+    uring_io_backend(unsigned _depth = IO_QUEUE_DEPTH) : ring_fd(-1), depth(_depth), sq_ptr(MAP_FAILED), cq_ptr(MAP_FAILED), sqes((struct io_uring_sqe*)MAP_FAILED), ok(false) {
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        ring_fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+        if (ring_fd < 0) {
+            logstream(LOG_WARNING) << "io_uring_setup failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        /* IORING_OP_READ/WRITE came with the same kernel as this feature */
+        if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+            logstream(LOG_WARNING) << "io_uring of this kernel lacks IORING_OP_READ/WRITE" << std::endl;
+            return;
+        }
+        depth = p.sq_entries;
+        sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            if (cq_sz > sq_sz) sq_sz = cq_sz;
+            cq_sz = sq_sz;
+        }
+        sq_ptr = mmap(NULL, sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) return;
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            cq_ptr = sq_ptr;
+        } else {
+            cq_ptr = mmap(NULL, cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED) return;
+        }
+        sqes = (struct io_uring_sqe*)mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return;
+
+        sq_head = (unsigned*)((char*)sq_ptr + p.sq_off.head);
+        sq_tail = (unsigned*)((char*)sq_ptr + p.sq_off.tail);
+        sq_mask = (unsigned*)((char*)sq_ptr + p.sq_off.ring_mask);
+        sq_array = (unsigned*)((char*)sq_ptr + p.sq_off.array);
+        cq_head = (unsigned*)((char*)cq_ptr + p.cq_off.head);
+        cq_tail = (unsigned*)((char*)cq_ptr + p.cq_off.tail);
+        cq_mask = (unsigned*)((char*)cq_ptr + p.cq_off.ring_mask);
+        cqes = (struct io_uring_cqe*)((char*)cq_ptr + p.cq_off.cqes);
+
+        inflight.resize(depth);
+        for (unsigned i = 0; i < depth; i++) freeslots.push_back(depth - 1 - i);
+        ok = true;
+    }
+
+    ~uring_io_backend() {
+        if (sqes != MAP_FAILED) munmap(sqes, depth * sizeof(struct io_uring_sqe));
+        if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap(cq_ptr, cq_sz);
+        if (sq_ptr != MAP_FAILED) munmap(sq_ptr, sq_sz);
+        if (ring_fd >= 0) close(ring_fd);
+    }
+
+    std::string name() { return "uring"; }
+
+    void register_files(const std::vector<int> &fds) {
+        if (!fixed_files.empty()) syscall(__NR_io_uring_register, ring_fd, IORING_UNREGISTER_FILES, NULL, 0);
+        fixed_files.clear();
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_FILES, &fds[0], (unsigned)fds.size()) < 0) {
+            logstream(LOG_WARNING) << "io_uring could not register files: " << strerror(errno) << std::endl;
+            return;
+        }
+        fixed_files = fds;
+    }
+
+    void register_buffers(const std::vector<struct iovec> &bufs) {
+        if (!fixed_bufs.empty()) syscall(__NR_io_uring_register, ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        fixed_bufs.clear();
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, &bufs[0], (unsigned)bufs.size()) < 0) {
+            logstream(LOG_WARNING) << "io_uring could not register buffers: " << strerror(errno) << std::endl;
+            return;
+        }
+        fixed_bufs = bufs;
+    }
+
+    void queue_read(int f, void *buf, size_t nbytes, size_t off) {
+        queue(f, (char*)buf, nbytes, off, false);
+    }
+
+    void queue_write(int f, const void *buf, size_t nbytes, size_t off) {
+        queue(f, (char*)buf, nbytes, off, true);
+    }
+
+    void submit() {
+        unsigned ninflight = 0, nunsubmitted = 0;
+        while (!pending.empty() || ninflight > 0) {
+            unsigned tail = *sq_tail;
+            unsigned nsubmit = 0;
+            while (!pending.empty() && !freeslots.empty()) {
+                unsigned slot = freeslots.back();
+                freeslots.pop_back();
+                inflight[slot] = pending.front();
+                pending.pop_front();
+                unsigned idx = tail & *sq_mask;
+                prep(&sqes[idx], inflight[slot], slot);
+                sq_array[idx] = idx;
+                tail++;
+                nsubmit++;
+            }
+            __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+            nunsubmitted += nsubmit;
+            int ret = (int)syscall(__NR_io_uring_enter, ring_fd, nunsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (ret < 0 && errno != EINTR && errno != EAGAIN) {
+                logstream(LOG_FATAL) << "io_uring_enter failed: " << strerror(errno) << std::endl;
+                assert(false);
+            }
+            if (ret > 0) nunsubmitted -= ret;
+            ninflight += nsubmit;
+            ninflight -= reap();
+        }
+    }
+
+private:
+    void queue(int f, char *buf, size_t nbytes, size_t off, bool write) {
+        while (nbytes > 0) {
+            size_t n = nbytes < (size_t)IO_CHUNK_SIZE ? nbytes : (size_t)IO_CHUNK_SIZE;
+            io_request req = { f, buf, n, off, write };
+            pending.push_back(req);
+            buf += n;
+            off += n;
+            nbytes -= n;
+        }
+    }
+
+    void prep(struct io_uring_sqe *sqe, const io_request &req, unsigned slot) {
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = req.write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = req.f;
+        for (unsigned i = 0; i < fixed_files.size(); i++) {
+            if (fixed_files[i] == req.f) {
+                sqe->fd = i;
+                sqe->flags |= IOSQE_FIXED_FILE;
+                break;
+            }
+        }
+        for (unsigned i = 0; i < fixed_bufs.size(); i++) {
+            char *base = (char*)fixed_bufs[i].iov_base;
+            if (req.buf >= base && req.buf + req.nbytes <= base + fixed_bufs[i].iov_len) {
+                sqe->opcode = req.write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+                sqe->buf_index = i;
+                break;
+            }
+        }
+        sqe->addr = (unsigned long)req.buf;
+        sqe->len = (unsigned)req.nbytes;
+        sqe->off = req.off;
+        sqe->user_data = slot;
+    }
+
+    /* collect completions, requeue the rest of short reads/writes */
+    unsigned reap() {
+        unsigned head = *cq_head;
+        unsigned ndone = 0;
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+            io_request req = inflight[cqe->user_data];
+            freeslots.push_back((unsigned)cqe->user_data);
+            if (cqe->res < 0) {
+                logstream(LOG_ERROR) << "Error, could not " << (req.write ? "write" : "read") << ": " << strerror(-cqe->res) << "; file-desc: " << req.f << " nbytes: " << req.nbytes << " off: " << req.off << std::endl;
+                assert(false);
+            }
+            assert(cqe->res > 0);
+            if ((size_t)cqe->res < req.nbytes) {
+                req.buf += cqe->res;
+                req.off += cqe->res;
+                req.nbytes -= cqe->res;
+                pending.push_front(req);
+            }
+            head++;
+            ndone++;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        return ndone;
+    }
+};
+
+#endif
+
+/**
+ * Create the I/O backend called name ("sync" or "uring"), falling back to
+ * sync if the requested one is not available.
+ */
+static io_backend *create_io_backend(std::string name) {
+#ifdef GRAPHWALKER_HAS_URING
+    if (name == "uring") {
+        uring_io_backend *uring = new uring_io_backend();
+        if (uring->ok) return uring;
+        delete uring;
+        logstream(LOG_WARNING) << "Fall back to sync I/O backend." << std::endl;
+    }
+#endif
+    if (name != "sync" && name != "uring") {
+        logstream(LOG_WARNING) << "Unknown I/O backend " << name << ", use sync." << std::endl;
+    }
+    return new sync_io_backend();
+}
+
+#endif
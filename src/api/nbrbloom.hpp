@@ -0,0 +1,161 @@
+#ifndef DEF_GRAPHWALKER_NBRBLOOM
+#define DEF_GRAPHWALKER_NBRBLOOM
+
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "api/datatype.hpp"
+#include "api/io.hpp"
+#include "logger/logger.hpp"
+
+#define NEIGHBOR_BLOOM_MAGIC 0x4d4c4252424e5747ULL // "GWNBRBLM"
+#define NEIGHBOR_BLOOM_VERSION 1
+#define NEIGHBOR_BLOOM_LINE 8 // 64 bit words, a cache line
+
+/**
+ * Neighbor Bloom filters, blocksize_<N>KB_<B>b.nbrbloom: for each block a
+ * blocked Bloom filter of its edges (u, v), B bits per edge, so whether v is
+ * an out neighbour of u is known without the block of u in memory, wrong
+ * only for a few false positives. An edge sets nhashes bits within one
+ * cache line. The header is followed by uint64_t offset[nblocks+1], in
+ * words, and the words of all blocks.
+ */
+struct neighbor_bloom_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t nblocks;
+    uint32_t bits_per_edge;
+    uint32_t nhashes;
+    uint64_t nwords;
+    uint64_t reserved[3];
+};
+
+static inline uint64_t neighbor_bloom_hash(vid_t u, vid_t v) {
+    uint64_t x = ((uint64_t)u << 32) | v;
+    x = (x ^ (x >> 33)) * 0xff51afd7ed558ccdULL;
+    x = (x ^ (x >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+/* bits per edge to the number of bits an edge sets, about ln 2 of them */
+static inline uint32_t neighbor_bloom_nhashes(uint32_t bits_per_edge) {
+    uint32_t k = (bits_per_edge * 69 + 50) / 100;
+    return k < 1 ? 1 : (k > 7 ? 7 : k);
+}
+
+/* words of the filter of a block of nedges edges, whole lines */
+static inline size_t neighbor_bloom_words(eid_t nedges, uint32_t bits_per_edge) {
+    size_t nlines = (nedges * bits_per_edge + NEIGHBOR_BLOOM_LINE * 64 - 1) / (NEIGHBOR_BLOOM_LINE * 64);
+    return (nlines > 0 ? nlines : 1) * NEIGHBOR_BLOOM_LINE;
+}
+
+/* the line of words an edge falls in, and its nhashes bits there as 9 bit fields of h */
+static inline uint64_t *neighbor_bloom_line(uint64_t *words, size_t nwords, uint64_t h) {
+    uint64_t nlines = nwords / NEIGHBOR_BLOOM_LINE;
+    return words + ((h >> 32) * nlines >> 32) * NEIGHBOR_BLOOM_LINE;
+}
+
+static inline void neighbor_bloom_add(uint64_t *words, size_t nwords, uint32_t nhashes, vid_t u, vid_t v) {
+    uint64_t h = neighbor_bloom_hash(u, v);
+    uint64_t *line = neighbor_bloom_line(words, nwords, h);
+    uint64_t g = h * 0x9e3779b97f4a7c15ULL;
+    for (uint32_t i = 0; i < nhashes; i++, g >>= 9)
+        line[(g & 511) >> 6] |= 1ULL << (g & 63);
+}
+
+static void write_neighbor_bloom(std::string fname, uint32_t bits_per_edge, const std::vector<uint64_t> &offs, const std::vector<uint64_t> &words) {
+    neighbor_bloom_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = NEIGHBOR_BLOOM_MAGIC;
+    hdr.version = NEIGHBOR_BLOOM_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.nblocks = offs.size() - 1;
+    hdr.bits_per_edge = bits_per_edge;
+    hdr.nhashes = neighbor_bloom_nhashes(bits_per_edge);
+    hdr.nwords = words.size();
+
+    int f = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+    if (f < 0) {
+        logstream(LOG_FATAL) << "Could not open " << fname << " error: " << strerror(errno) << std::endl;
+    }
+    assert(f >= 0);
+    size_t off = 0;
+    pwritea(f, (char*)&hdr, sizeof(hdr), off);
+    off += sizeof(hdr);
+    pwritea(f, (char*)&offs[0], offs.size() * sizeof(uint64_t), off);
+    off += offs.size() * sizeof(uint64_t);
+    if (!words.empty()) pwritea(f, (char*)&words[0], words.size() * sizeof(uint64_t), off);
+    close(f);
+}
+
+/**
+ * Resident mapping of the neighbor Bloom filters of all blocks, populated
+ * at open. A lookup reads one cache line.
+ */
+class neighbor_bloom {
+    void *map;
+    size_t map_sz;
+
+public:
+    neighbor_bloom_header *hdr;
+    uint64_t *offs;
+    uint64_t *words;
+
+    neighbor_bloom() : map(NULL), map_sz(0), hdr(NULL), offs(NULL), words(NULL) {}
+
+    ~neighbor_bloom() {
+        if (map != NULL) munmap(map, map_sz);
+    }
+
+    /* false if fname is missing or not neighbor Bloom filters of this version */
+    bool open(std::string fname) {
+        int f = ::open(fname.c_str(), O_RDONLY);
+        if (f < 0) return false;
+        map_sz = lseek(f, 0, SEEK_END);
+        if (map_sz < sizeof(neighbor_bloom_header)) {
+            ::close(f);
+            return false;
+        }
+        map = mmap(NULL, map_sz, PROT_READ, MAP_SHARED | MAP_POPULATE, f, 0);
+        ::close(f);
+        if (map == MAP_FAILED) {
+            map = NULL;
+            return false;
+        }
+        hdr = (neighbor_bloom_header*)map;
+        size_t need = hdr->header_size + (hdr->nblocks + 1) * sizeof(uint64_t) + hdr->nwords * sizeof(uint64_t);
+        if (hdr->magic != NEIGHBOR_BLOOM_MAGIC || hdr->version != NEIGHBOR_BLOOM_VERSION || map_sz < need) {
+            logstream(LOG_WARNING) << "Ignore neighbor Bloom filters " << fname << " of another version." << std::endl;
+            munmap(map, map_sz);
+            map = NULL;
+            hdr = NULL;
+            return false;
+        }
+        offs = (uint64_t*)((char*)map + hdr->header_size);
+        words = offs + hdr->nblocks + 1;
+        return true;
+    }
+
+    bool loaded() {
+        return hdr != NULL;
+    }
+
+    /* v may be an out neighbour of u, which is in block p */
+    inline bool mayContain(bid_t p, vid_t u, vid_t v) {
+        uint64_t h = neighbor_bloom_hash(u, v);
+        uint64_t *line = neighbor_bloom_line(words + offs[p], offs[p+1] - offs[p], h);
+        uint64_t g = h * 0x9e3779b97f4a7c15ULL;
+        for (uint32_t i = 0; i < hdr->nhashes; i++, g >>= 9)
+            if (!(line[(g & 511) >> 6] & (1ULL << (g & 63)))) return false;
+        return true;
+    }
+};
+
+#endif
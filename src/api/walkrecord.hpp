@@ -0,0 +1,139 @@
+#ifndef DEF_GRAPHWALKER_WALKRECORD
+#define DEF_GRAPHWALKER_WALKRECORD
+
+#include <stdint.h>
+
+/**
+ * Layouts of a walk, chosen at compile time with -DWALK_RECORD:
+ *  64  source 24 bits, current 26 bits and hop 14 bits in one word, the default
+ *  96  32 bit source, current and hop
+ *  128 as 96, plus a 32 bit walk id to index per walk state
+ *  160 as 128, plus the vertex the walk came from, for second order walks
+ * current is the offset of the walk's vertex in its block, prev is
+ * NO_PREV until the first step and in the layouts that do not keep it.
+ * Every layout
+ * has the same static interface, so the walk code compiles down to the
+ * plain bit operations of the one in use.
+ */
+#define NO_PREV 0xffffffff
+
+template <int BITS> struct walk_record;
+
+template <> struct walk_record<64> {
+    typedef uint64_t type;
+    typedef uint16_t hop_type;
+    static const bool has_id = false;
+    static const bool has_prev = false;
+    static const uint64_t max_source = 0xffffff;
+    static const uint64_t max_current = 0x3ffffff;
+    static const uint64_t max_hop = 0x3fff;
+
+    static inline type encode(uint32_t source, uint32_t current, hop_type hop, uint32_t id) {
+        return (((type)source & 0xffffff) << 40) | (((type)current & 0x3ffffff) << 14) | ((type)hop & 0x3fff);
+    }
+    static inline uint32_t source(type w) { return (uint32_t)(w >> 40) & 0xffffff; }
+    static inline uint32_t current(type w) { return (uint32_t)(w >> 14) & 0x3ffffff; }
+    static inline hop_type hop(type w) { return (hop_type)(w & 0x3fff); }
+    static inline uint32_t id(type w) { return 0; }
+    static inline uint32_t prev(type w) { return NO_PREV; }
+    static inline void next_hop(type &w) { w++; }
+    static inline type step_from(type w, uint32_t prev) { return w; }
+    static inline type move(type w, uint32_t current) {
+        return (w & ~((type)0x3ffffff << 14)) | (((type)current & 0x3ffffff) << 14);
+    }
+};
+
+struct walk96 {
+    uint32_t source, current, hop;
+};
+
+template <> struct walk_record<96> {
+    typedef walk96 type;
+    typedef uint32_t hop_type;
+    static const bool has_id = false;
+    static const bool has_prev = false;
+    static const uint64_t max_source = 0xffffffff;
+    static const uint64_t max_current = 0xffffffff;
+    static const uint64_t max_hop = 0xfffffffe;
+
+    static inline type encode(uint32_t source, uint32_t current, hop_type hop, uint32_t id) {
+        type w = { source, current, hop };
+        return w;
+    }
+    static inline uint32_t source(const type &w) { return w.source; }
+    static inline uint32_t current(const type &w) { return w.current; }
+    static inline hop_type hop(const type &w) { return w.hop; }
+    static inline uint32_t id(const type &w) { return 0; }
+    static inline uint32_t prev(const type &w) { return NO_PREV; }
+    static inline void next_hop(type &w) { w.hop++; }
+    static inline type step_from(type w, uint32_t prev) { return w; }
+    static inline type move(type w, uint32_t current) {
+        w.current = current;
+        return w;
+    }
+};
+
+struct walk128 {
+    uint32_t source, current, hop, id;
+};
+
+template <> struct walk_record<128> {
+    typedef walk128 type;
+    typedef uint32_t hop_type;
+    static const bool has_id = true;
+    static const bool has_prev = false;
+    static const uint64_t max_source = 0xffffffff;
+    static const uint64_t max_current = 0xffffffff;
+    static const uint64_t max_hop = 0xfffffffe;
+
+    static inline type encode(uint32_t source, uint32_t current, hop_type hop, uint32_t id) {
+        type w = { source, current, hop, id };
+        return w;
+    }
+    static inline uint32_t source(const type &w) { return w.source; }
+    static inline uint32_t current(const type &w) { return w.current; }
+    static inline hop_type hop(const type &w) { return w.hop; }
+    static inline uint32_t id(const type &w) { return w.id; }
+    static inline uint32_t prev(const type &w) { return NO_PREV; }
+    static inline void next_hop(type &w) { w.hop++; }
+    static inline type step_from(type w, uint32_t prev) { return w; }
+    static inline type move(type w, uint32_t current) {
+        w.current = current;
+        return w;
+    }
+};
+
+struct walk160 {
+    uint32_t source, current, hop, id, prev;
+};
+
+template <> struct walk_record<160> {
+    typedef walk160 type;
+    typedef uint32_t hop_type;
+    static const bool has_id = true;
+    static const bool has_prev = true;
+    static const uint64_t max_source = 0xfffffffe; //NO_PREV is kept apart
+    static const uint64_t max_current = 0xffffffff;
+    static const uint64_t max_hop = 0xfffffffe;
+
+    static inline type encode(uint32_t source, uint32_t current, hop_type hop, uint32_t id) {
+        type w = { source, current, hop, id, NO_PREV };
+        return w;
+    }
+    static inline uint32_t source(const type &w) { return w.source; }
+    static inline uint32_t current(const type &w) { return w.current; }
+    static inline hop_type hop(const type &w) { return w.hop; }
+    static inline uint32_t id(const type &w) { return w.id; }
+    static inline uint32_t prev(const type &w) { return w.prev; }
+    static inline void next_hop(type &w) { w.hop++; }
+    static inline type step_from(type w, uint32_t prev) {
+        w.prev = prev;
+        return w;
+    }
+    static inline type move(type w, uint32_t current) {
+        w.current = current;
+        return w;
+    }
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef DEF_GRAPHWALKER_BLOCKARENA
+#define DEF_GRAPHWALKER_BLOCKARENA
+
+#include <map>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#include "api/datatype.hpp"
+#include "api/pthread_tools.hpp"
+#include "logger/logger.hpp"
+#include "util/hugepage.hpp"
+
+/**
+ * Buffers of the in memory block slots. Every slot owns a beg_pos and a csr
+ * slab allocated up front; a block whose csr does not fit its slab borrows a
+ * buffer from a shared overflow pool and gives it back when evicted, so that
+ * swapping blocks in steady state allocates nothing. Slabs never move, as
+ * they may be registered with the I/O backends. With huge pages all slabs
+ * are carved from one huge page region, so small slabs share pages.
+ */
+class block_arena {
+    bid_t nslots;
+    size_t align; //0 for plain malloc
+    char **beg_posslab, **csrslab;
+    size_t beg_posslab_sz, csrslab_sz;
+    char *region; //all slabs, when on huge pages
+    size_t region_sz;
+
+    /* Overflow pool */
+    char **over; //overflow buffer held by each slot, NULL otherwise
+    size_t *over_sz;
+    std::multimap<size_t, char*> pool; //free overflow buffers by size
+    mutex pool_lock;
+
+    /* put the overflow buffer of slot back to the pool, pool_lock held */
+    void giveBack(bid_t slot) {
+        if (over[slot] == NULL) return;
+        pool.insert(std::make_pair(over_sz[slot], over[slot]));
+        over[slot] = NULL;
+        over_sz[slot] = 0;
+    }
+
+public:
+    block_arena(bid_t _nslots, size_t _beg_posslab_sz, size_t _csrslab_sz, size_t _align, bool pin, hugepage_t huge = HUGEPAGE_NONE)
+        : nslots(_nslots), align(_align), beg_posslab_sz(_beg_posslab_sz), csrslab_sz(_csrslab_sz), region(NULL), region_sz(0) {
+        beg_posslab = (char**)malloc(nslots*sizeof(char*));
+        csrslab = (char**)malloc(nslots*sizeof(char*));
+        over = (char**)malloc(nslots*sizeof(char*));
+        over_sz = (size_t*)malloc(nslots*sizeof(size_t));
+        size_t step = align > 64 ? align : 64;
+        size_t beg_posstride = (beg_posslab_sz + step - 1) / step * step;
+        size_t csrstride = (csrslab_sz + step - 1) / step * step;
+        if (huge != HUGEPAGE_NONE) {
+            region = (char*)hugepage_alloc(nslots * (beg_posstride + csrstride), huge, &region_sz);
+        }
+        bool pinned = true;
+        for (bid_t s = 0; s < nslots; s++) {
+            if (region != NULL) {
+                csrslab[s] = region + s * csrstride;
+                beg_posslab[s] = region + nslots * csrstride + s * beg_posstride;
+            } else {
+                beg_posslab[s] = alloc(beg_posslab_sz);
+                csrslab[s] = alloc(csrslab_sz);
+            }
+            over[s] = NULL;
+            over_sz[s] = 0;
+            if (pin && region == NULL) pinned &= mlock(csrslab[s], csrslab_sz) == 0 && mlock(beg_posslab[s], beg_posslab_sz) == 0;
+        }
+        if (pin && region != NULL) pinned = mlock(region, region_sz) == 0;
+        if (!pinned) {
+            logstream(LOG_WARNING) << "Could not lock the block buffer pool in memory: " << strerror(errno) << std::endl;
+        }
+    }
+
+    ~block_arena() {
+        for (bid_t s = 0; s < nslots; s++) {
+            if (region == NULL) {
+                free(beg_posslab[s]);
+                free(csrslab[s]);
+            }
+            if (over[s] != NULL) free(over[s]);
+        }
+        if (region != NULL) hugepage_free(region, region_sz);
+        for (std::multimap<size_t, char*>::iterator it = pool.begin(); it != pool.end(); it++)
+            free(it->second);
+        free(beg_posslab);
+        free(csrslab);
+        free(over);
+        free(over_sz);
+    }
+
+    /* nbytes, aligned to align if set */
+    char *alloc(size_t nbytes) {
+        if (align == 0) return (char*)malloc(nbytes);
+        void *buf = NULL;
+        if (posix_memalign(&buf, align, nbytes) != 0) {
+            logstream(LOG_FATAL) << "Could not allocate " << nbytes << " aligned bytes" << std::endl;
+            assert(false);
+        }
+        return (char*)buf;
+    }
+
+    char *beg_pos(bid_t slot) {
+        return beg_posslab[slot];
+    }
+
+    /**
+     * Buffer of slot for nbytes of csr: the slab, or the smallest free
+     * overflow buffer that fits. When none fits, one too small is freed
+     * first, so the pool never holds more buffers than there are slots.
+     */
+    char *csr(bid_t slot, size_t nbytes) {
+        if (nbytes <= csrslab_sz && over[slot] == NULL) return csrslab[slot];
+        if (nbytes > csrslab_sz && nbytes <= over_sz[slot]) return over[slot];
+        pool_lock.lock();
+        giveBack(slot);
+        if (nbytes <= csrslab_sz) {
+            pool_lock.unlock();
+            return csrslab[slot];
+        }
+        std::multimap<size_t, char*>::iterator it = pool.lower_bound(nbytes);
+        if (it != pool.end()) {
+            over_sz[slot] = it->first;
+            over[slot] = it->second;
+            pool.erase(it);
+        } else {
+            if (!pool.empty()) {
+                free(pool.begin()->second);
+                pool.erase(pool.begin());
+            }
+            over_sz[slot] = (nbytes + csrslab_sz - 1) / csrslab_sz * csrslab_sz;
+            over[slot] = alloc(over_sz[slot]);
+        }
+        pool_lock.unlock();
+        return over[slot];
+    }
+
+    /* slot is being emptied, its overflow buffer may be lent again */
+    void release(bid_t slot) {
+        if (over[slot] == NULL) return;
+        pool_lock.lock();
+        giveBack(slot);
+        pool_lock.unlock();
+    }
+
+    std::vector<struct iovec> csrSlabs() {
+        std::vector<struct iovec> bufs(nslots);
+        for (bid_t s = 0; s < nslots; s++) {
+            bufs[s].iov_base = csrslab[s];
+            bufs[s].iov_len = csrslab_sz;
+        }
+        return bufs;
+    }
+};
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef DEF_GRAPHWALKER_CACHEPOLICY
+#define DEF_GRAPHWALKER_CACHEPOLICY
+
+#include <string>
+#include <vector>
+#include <set>
+#include <list>
+#include <utility>
+#include <algorithm>
+
+#include "api/datatype.hpp"
+#include "logger/logger.hpp"
+#include "walks/walk.hpp"
+
+/**
+ * Which resident blocks may be evicted right now, e.g. not the block being
+ * executed or a block the prefetch thread is still filling.
+ */
+class evict_filter {
+public:
+    virtual ~evict_filter() {}
+    virtual bool evictable(bid_t b) = 0;
+};
+
+/**
+ * Replacement policy of the in memory block cache. It tracks the resident
+ * blocks and is only used from the engine's main thread.
+ */
+class cache_policy {
+public:
+    virtual ~cache_policy() {}
+
+    virtual std::string name() = 0;
+
+    /* block b became resident */
+    virtual void insert(bid_t b) = 0;
+
+    /* block b was evicted */
+    virtual void erase(bid_t b) = 0;
+
+    /* resident block b of nbytes was used */
+    virtual void touch(bid_t b, size_t nbytes) {}
+
+    /* walknum or minstep of block b changed, resident or not */
+    virtual void recount(bid_t b) {}
+
+    /* resident block to evict, nblocks if no resident block passes filter */
+    virtual bid_t victim(evict_filter &filter) = 0;
+};
+
+/**
+ * Base of the policies that evict the resident block of lowest priority,
+ * kept ordered in a set so a victim is found in O(log n).
+ */
+class keyed_cache_policy : public cache_policy {
+protected:
+    bid_t nblocks;
+    std::set< std::pair<double, bid_t> > order;
+    std::vector<double> key;
+    std::vector<bool> resident;
+
+    virtual double priority(bid_t b) = 0;
+
+    void update(bid_t b) {
+        double k = priority(b);
+        if (k == key[b]) return;
+        order.erase(std::make_pair(key[b], b));
+        key[b] = k;
+        order.insert(std::make_pair(k, b));
+    }
+
+public:
+    keyed_cache_policy(bid_t _nblocks) : nblocks(_nblocks), key(_nblocks, 0), resident(_nblocks, false) {}
+
+    virtual void insert(bid_t b) {
+        key[b] = priority(b);
+        order.insert(std::make_pair(key[b], b));
+        resident[b] = true;
+    }
+
+    virtual void erase(bid_t b) {
+        order.erase(std::make_pair(key[b], b));
+        resident[b] = false;
+    }
+
+    virtual void recount(bid_t b) {
+        if (resident[b]) update(b);
+    }
+
+    virtual bid_t victim(evict_filter &filter) {
+        for (std::set< std::pair<double, bid_t> >::iterator it = order.begin(); it != order.end(); it++)
+            if (filter.evictable(it->second)) return it->second;
+        return nblocks;
+    }
+};
+
+/**
+ * Evict the block with fewest walks, the engine's original policy.
+ */
+class walks_cache_policy : public keyed_cache_policy {
+    WalkManager *walk_manager;
+
+protected:
+    virtual double priority(bid_t b) {
+        return walk_manager->walknum[b];
+    }
+
+public:
+    walks_cache_policy(bid_t _nblocks, WalkManager *_walk_manager) : keyed_cache_policy(_nblocks), walk_manager(_walk_manager) {}
+
+    virtual std::string name() { return "walks"; }
+};
+
+/**
+ * Evict the least recently used block.
+ */
+class lru_cache_policy : public keyed_cache_policy {
+    std::vector<double> lastuse;
+    double tick;
+
+protected:
+    virtual double priority(bid_t b) {
+        return lastuse[b];
+    }
+
+public:
+    lru_cache_policy(bid_t _nblocks) : keyed_cache_policy(_nblocks), lastuse(_nblocks, 0), tick(0) {}
+
+    virtual std::string name() { return "lru"; }
+
+    virtual void insert(bid_t b) {
+        lastuse[b] = ++tick;
+        keyed_cache_policy::insert(b);
+    }
+
+    virtual void touch(bid_t b, size_t nbytes) {
+        lastuse[b] = ++tick;
+        update(b);
+    }
+
+    virtual void recount(bid_t b) {}
+};
+
+/**
+ * Evict the block that is cheapest to lose: a block is worth the bytes it
+ * takes to reload times how likely it is to be executed again, which grows
+ * with its walks and past uses, and with lagging walks (small minstep) that
+ * the min-step choice of chooseBlock will come back for.
+ */
+class cost_cache_policy : public keyed_cache_policy {
+    WalkManager *walk_manager;
+    std::vector<double> nbytes; //0 until the block is first used
+    std::vector<double> hits;
+    double sumbytes, nsized;
+
+protected:
+    virtual double priority(bid_t b) {
+        double bytes = nbytes[b] > 0 ? nbytes[b] : (nsized > 0 ? sumbytes / nsized : 1);
+        double reuse = walk_manager->walknum[b] + hits[b];
+        hid_t mins = walk_manager->minstep[b];
+        if (mins != (hid_t)-1) reuse *= 1 + 1.0 / (1 + mins);
+        return bytes * reuse;
+    }
+
+public:
+    cost_cache_policy(bid_t _nblocks, WalkManager *_walk_manager) : keyed_cache_policy(_nblocks), walk_manager(_walk_manager),
+        nbytes(_nblocks, 0), hits(_nblocks, 0), sumbytes(0), nsized(0) {}
+
+    virtual std::string name() { return "cost"; }
+
+    virtual void insert(bid_t b) {
+        hits[b] = 0;
+        keyed_cache_policy::insert(b);
+    }
+
+    virtual void touch(bid_t b, size_t _nbytes) {
+        if (nbytes[b] == 0) {
+            nbytes[b] = _nbytes;
+            sumbytes += _nbytes;
+            nsized++;
+        }
+        hits[b]++;
+        update(b);
+    }
+};
+
+/**
+ * Adaptive replacement cache: resident blocks seen once (t1) and more than
+ * once (t2), plus ghost lists of blocks recently evicted from each (b1, b2)
+ * that move the target size p of t1. Lists are in LRU to MRU order, with an
+ * iterator per block so every operation is O(1).
+ */
+class arc_cache_policy : public cache_policy {
+    enum { NONE, T1, T2, B1, B2 };
+    bid_t nblocks;
+    size_t c, p;
+    std::list<bid_t> lists[5];
+    std::vector<unsigned char> where;
+    std::vector< std::list<bid_t>::iterator > pos;
+    std::vector<bool> fresh; //inserted and not used yet
+
+    void move(bid_t b, unsigned char to) {
+        if (where[b] != NONE) lists[where[b]].erase(pos[b]);
+        where[b] = to;
+        if (to != NONE) pos[b] = lists[to].insert(lists[to].end(), b);
+    }
+
+    bid_t lruOf(unsigned char l, evict_filter &filter) {
+        for (std::list<bid_t>::iterator it = lists[l].begin(); it != lists[l].end(); it++)
+            if (filter.evictable(*it)) return *it;
+        return nblocks;
+    }
+
+public:
+    arc_cache_policy(bid_t _nblocks, bid_t nmblocks) : nblocks(_nblocks), c(nmblocks), p(0),
+        where(_nblocks, NONE), pos(_nblocks), fresh(_nblocks, false) {}
+
+    virtual std::string name() { return "arc"; }
+
+    virtual void insert(bid_t b) {
+        size_t nb1 = lists[B1].size(), nb2 = lists[B2].size();
+        if (where[b] == B1) {
+            p = std::min(c, p + std::max(nb2 / nb1, (size_t)1));
+            move(b, T2);
+        } else if (where[b] == B2) {
+            size_t d = std::max(nb1 / nb2, (size_t)1);
+            p = p > d ? p - d : 0;
+            move(b, T2);
+        } else {
+            move(b, T1);
+        }
+        fresh[b] = true;
+    }
+
+    virtual void erase(bid_t b) {
+        move(b, where[b] == T1 ? B1 : B2);
+        while (lists[T1].size() + lists[B1].size() > c && !lists[B1].empty())
+            move(lists[B1].front(), NONE);
+        while (lists[T1].size() + lists[T2].size() + lists[B1].size() + lists[B2].size() > 2 * c && !lists[B2].empty())
+            move(lists[B2].front(), NONE);
+    }
+
+    virtual void touch(bid_t b, size_t nbytes) {
+        if (fresh[b]) {
+            fresh[b] = false;
+            return;
+        }
+        move(b, T2);
+    }
+
+    virtual bid_t victim(evict_filter &filter) {
+        bool fromt1 = !lists[T1].empty() && (lists[T1].size() > p || lists[T2].empty());
+        bid_t v = lruOf(fromt1 ? T1 : T2, filter);
+        if (v == nblocks) v = lruOf(fromt1 ? T2 : T1, filter);
+        return v;
+    }
+};
+
+/**
+ * Create the cache policy called name ("walks", "lru", "arc" or "cost"),
+ * falling back to walks for unknown names.
+ */
+static cache_policy *create_cache_policy(std::string name, bid_t nblocks, bid_t nmblocks, WalkManager *walk_manager) {
+    if (name == "lru") return new lru_cache_policy(nblocks);
+    if (name == "arc") return new arc_cache_policy(nblocks, nmblocks);
+    if (name == "cost") return new cost_cache_policy(nblocks, walk_manager);
+    if (name != "walks") {
+        logstream(LOG_WARNING) << "Unknown cache policy " << name << ", use walks." << std::endl;
+    }
+    return new walks_cache_policy(nblocks, walk_manager);
+}
+
+#endif
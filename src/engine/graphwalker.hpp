@@ -12,16 +12,37 @@
 #include <omp.h>
 #include <vector>
 #include <map>
+#include <deque>
+#include <pthread.h>
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <asm/mman.h>
 
 #include "api/filename.hpp"
 #include "api/io.hpp"
+#include "api/iobackend.hpp"
+#include "api/blockindex.hpp"
+#include "api/hotvertices.hpp"
+#include "api/edgealias.hpp"
+#include "api/nbrbloom.hpp"
 #include "logger/logger.hpp"
 #include "metrics/metrics.hpp"
 #include "api/pthread_tools.hpp"
 #include "walks/randomwalk.hpp"
+#include "walks/interleave.hpp"
+#include "engine/cachepolicy.hpp"
+#include "engine/blockarena.hpp"
+#include "util/varint.hpp"
+
+/* how findSubGraph brings a block into memory */
+enum loadmode_t { LOAD_PREAD, LOAD_MMAP, LOAD_DIRECT };
+
+/* what a thread loading blocks owns: its I/O backend and staging buffer */
+struct block_loader {
+    io_backend *io;
+    char *scratch; //compressed csr of the block being decoded
+    size_t scratch_sz;
+};
 
 class graphwalker_engine {
 public:     
@@ -31,16 +52,68 @@ public:
     bid_t nblocks;  
     vid_t nvertices;      
     tid_t exec_threads;
-    vid_t* blocks;
+    vid_t* blocks; //first vertex of each block, in the mapped block index
+    block_index bindex;
     timeval start;
     
     /* Ｉn memory blocks */
     bid_t nmblocks; //number of in memory blocks
     vid_t **csrbuf;
     eid_t **beg_posbuf;
+    block_arena *arena; //buffers of the slots, NULL with loadmode mmap
+    hugepage_t hugepages;
     bid_t cmblocks; //current number of in memory blocks
     bid_t *inMemIndex;
+    cache_policy *cache; //chooses the block to swap out
     int beg_posf, csrf;
+    block_loader loader; //block loads of the main thread
+
+    /* Memory mapped graph files, for loadmode mmap */
+    loadmode_t loadmode;
+    eid_t *beg_posmap;
+    vid_t *csrmap;
+    size_t beg_posmap_sz, csrmap_sz;
+
+    /* O_DIRECT graph files, for loadmode direct */
+    int beg_posdf, csrdf;
+    size_t beg_posf_sz, csrf_sz;
+
+    /* Compressed csr and the byte offset of each block in it, for option compressed */
+    bool compressed;
+    eid_t *vcsrindex;
+    int vcsrf, vcsrdf;
+    size_t vcsrf_sz;
+
+    /* Edge alias tables, parallel to the csr and loaded with it, for option weighted */
+    bool weighted;
+    alias_entry **aliasbuf;
+    block_arena *aliasarena; //alias buffers of the slots, NULL with loadmode mmap
+    int aliasf, aliasdf;
+    size_t aliasf_sz;
+    alias_entry *aliasmap;
+    size_t aliasmap_sz;
+
+    /* Adjacency of the high degree vertices, kept apart from the blocks, for option hotcache_kb */
+    unsigned long long hotcache_kb;
+    hot_vertices hot;
+
+    /* Edges of every block in a Bloom filter, for second order walks, for option bloom_bits */
+    unsigned bloom_bits;
+    neighbor_bloom bloom;
+
+    bool sortwalks; //run the walks of a block in order of their vertex, for option sortwalks
+    unsigned interleave; //walks a thread steps in lock-step, 0 for one at a time
+    double checkpoint_sec; //between checkpoints of the walks, 0 for none
+
+    /* Prefetch */
+    bid_t nprefetch; //number of predicted blocks loaded ahead by the I/O thread
+    bool *loading; //in memory slots the I/O thread is still filling
+    std::deque< std::pair<bid_t, bid_t> > prefetch_queue; //(block, slot) to load
+    bool prefetch_stop;
+    mutex prefetch_lock;
+    conditional prefetch_cond;
+    pthread_t prefetch_thread;
+    block_loader prefetch_loader;
 
     /* State */
     bid_t exec_block;
@@ -55,6 +128,18 @@ public:
         logstream(LOG_INFO) << " blocksize_kb = " << blocksize_kb << "kb" << std::endl;
         logstream(LOG_INFO) << " number of total blocks = " << nblocks << std::endl;
         logstream(LOG_INFO) << " number of in-memory blocks = " << nmblocks << std::endl;
+        logstream(LOG_INFO) << " number of prefetched blocks = " << nprefetch << std::endl;
+        logstream(LOG_INFO) << " cache policy = " << cache->name() << std::endl;
+        logstream(LOG_INFO) << " I/O backend = " << loader.io->name() << std::endl;
+        logstream(LOG_INFO) << " load mode = " << (loadmode == LOAD_MMAP ? "mmap" : loadmode == LOAD_DIRECT ? "direct" : "pread") << std::endl;
+        logstream(LOG_INFO) << " compressed csr = " << compressed << std::endl;
+        logstream(LOG_INFO) << " huge pages = " << hugepages_name(hugepages) << std::endl;
+        logstream(LOG_INFO) << " weighted = " << weighted << std::endl;
+        logstream(LOG_INFO) << " hot vertices = " << hot.size() << " (" << hotcache_kb << "kb)" << std::endl;
+        logstream(LOG_INFO) << " neighbor Bloom filters = " << bloom_bits << " bits per edge" << std::endl;
+        logstream(LOG_INFO) << " sort walks = " << sortwalks << std::endl;
+        logstream(LOG_INFO) << " interleaved walks = " << interleave << std::endl;
+        logstream(LOG_INFO) << " checkpoint every = " << checkpoint_sec << "s" << (walk_manager->resumed ? ", resumed" : "") << std::endl;
     }
 
     double runtime() {
@@ -78,27 +163,20 @@ public:
         load_block_range(base_filename, blocksize_kb, blocks);
         logstream(LOG_INFO) << "block_range loaded!" << std::endl;
         nvertices = num_vertices();
+        vid_t maxblockverts = 0;
+        for(bid_t p = 0; p < nblocks; p++)
+            if(blocks[p+1] - blocks[p] > maxblockverts) maxblockverts = blocks[p+1] - blocks[p];
+        if((nvertices > 0 && (uint64_t)(nvertices-1) > walk_layout::max_source) || (uint64_t)maxblockverts > walk_layout::max_current + 1){
+            logstream(LOG_FATAL) << "The graph does not fit the " << WALK_RECORD << " bit walk record (" << nvertices << " vertices, " << maxblockverts << " in the largest block), rebuild with -DWALK_RECORD=96." << std::endl;
+            assert(false);
+        }
         walk_manager = new WalkManager(m,nblocks,exec_threads,base_filename);
         logstream(LOG_INFO) << "walk_manager created!" << std::endl;
 
-        csrbuf = (vid_t**)malloc(nmblocks*sizeof(vid_t*));
-        for(bid_t b = 0; b < nmblocks; b++){
-            csrbuf[b] = (vid_t*)malloc(blocksize_kb*1024);
-            // csrbuf[b] = (vid_t *)mmap(NULL, blocksize_kb*1024,
-            //         PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS 
-            //         //| MAP_HUGETLB | MAP_HUGE_2MB
-            //         , 0, 0);
-            // if(csrbuf[b] == MAP_FAILED){
-            //     printf("%lld\n",b*blocksize_kb*1024);
-            //     perror("csrbuf alloc mmap");
-            //     exit(-1);
-            // }
-        }
-        logstream(LOG_INFO) << "csrbuf malloced!" << std::endl;
-        beg_posbuf = (eid_t**)malloc(nmblocks*sizeof(eid_t*));
         inMemIndex = (bid_t*)malloc(nblocks*sizeof(bid_t));
         for(bid_t b = 0; b < nblocks; b++)  inMemIndex[b] = nmblocks;
         cmblocks = 0;
+        cache = create_cache_policy(get_option_string("cachepolicy", "walks"), nblocks, nmblocks, walk_manager);
 
         // m.start_time("__g_loadSubGraph_filename");
         std::string invlname = fidname( base_filename, 0 ); //only 1 file
@@ -118,6 +196,68 @@ public:
         assert(csrf > 0 && beg_posf > 0);
         // m.stop_time("__g_loadSubGraph_if_open_success");
 
+        std::string mode = get_option_string("loadmode", "pread");
+        loadmode = LOAD_PREAD;
+        if(mode == "mmap") loadmode = LOAD_MMAP;
+        else if(mode == "direct") loadmode = LOAD_DIRECT;
+        else if(mode != "pread") logstream(LOG_WARNING) << "Unknown loadmode " << mode << ", use pread." << std::endl;
+        hugepages = parse_hugepages(get_option_string("hugepages", "none"));
+
+        beg_posmap = NULL;
+        csrmap = NULL;
+        beg_posdf = csrdf = -1;
+        if(loadmode == LOAD_MMAP){
+            mapGraph();
+        }else if(loadmode == LOAD_DIRECT){
+            beg_posdf = open(beg_posname.c_str(), O_RDONLY | O_DIRECT);
+            csrdf = open(csrname.c_str(), O_RDONLY | O_DIRECT);
+            if(beg_posdf < 0 || csrdf < 0){
+                logstream(LOG_WARNING) << "Could not open graph files with O_DIRECT, error: " << strerror(errno) << ", use pread." << std::endl;
+                if(beg_posdf >= 0) close(beg_posdf);
+                if(csrdf >= 0) close(csrdf);
+                beg_posdf = csrdf = -1;
+                loadmode = LOAD_PREAD;
+            }
+            beg_posf_sz = lseek(beg_posf, 0, SEEK_END);
+            csrf_sz = lseek(csrf, 0, SEEK_END);
+        }
+        openCompressed(invlname);
+        openAlias(invlname);
+        allocSlots();
+
+        hotcache_kb = get_option_long("hotcache_kb", 0);
+        if(hotcache_kb > 0 && weighted){
+            logstream(LOG_WARNING) << "The hot vertex store has no edge weights, it is not used with option weighted." << std::endl;
+        }else if(hotcache_kb > 0 && !hot.open(hotverticesname(base_filename, hotcache_kb))){
+            logstream(LOG_WARNING) << "Could not load the hot vertex store for hotcache_kb = " << hotcache_kb << ", walks leave at every block boundary." << std::endl;
+        }
+
+        bloom_bits = get_option_int("bloom_bits", 0);
+        if(bloom_bits > 0 && !bloom.open(neighborbloomname(base_filename, blocksize_kb, bloom_bits))){
+            logstream(LOG_WARNING) << "Could not load the neighbor Bloom filters for bloom_bits = " << bloom_bits << "." << std::endl;
+            bloom_bits = 0;
+        }
+
+        sortwalks = get_option_int("sortwalks", 0);
+        interleave = get_option_int("interleave", 0);
+        if(interleave > INTERLEAVE_MAX) interleave = INTERLEAVE_MAX;
+        checkpoint_sec = get_option_float("checkpoint_sec", 0);
+
+        std::string iobackend = get_option_string("iobackend", "sync");
+        initLoader(loader, iobackend);
+
+        nprefetch = get_option_int("prefetch", 0);
+        if(nprefetch >= nmblocks) nprefetch = nmblocks - 1; //keep a slot for the block on demand
+        loading = (bool*)malloc(nmblocks*sizeof(bool));
+        memset(loading, false, nmblocks*sizeof(bool));
+        prefetch_stop = false;
+        prefetch_loader.io = NULL;
+        if(nprefetch > 0){
+            initLoader(prefetch_loader, iobackend);
+            int error = pthread_create(&prefetch_thread, NULL, prefetch_loop, this);
+            assert(!error);
+        }
+
         _m.set("file", _base_filename);
         _m.set("engine", "default");
         _m.set("nblocks", (size_t)nblocks);
@@ -126,53 +266,292 @@ public:
     }
         
     virtual ~graphwalker_engine() {
+        if(nprefetch > 0){
+            prefetch_lock.lock();
+            prefetch_stop = true;
+            prefetch_cond.broadcast();
+            prefetch_lock.unlock();
+            pthread_join(prefetch_thread, NULL);
+        }
+        if(loading != NULL) free(loading);
+        if(prefetch_loader.io != NULL) freeLoader(prefetch_loader);
+        freeLoader(loader);
+        delete cache;
         delete walk_manager;
         
         if(inMemIndex != NULL) free(inMemIndex);
-        if(blocks != NULL) free(blocks);
 
-        for(bid_t b = 0; b < cmblocks; b++){
-            if(beg_posbuf[b] != NULL)   free(beg_posbuf[b]);
-            if(csrbuf[b] != NULL)   free(csrbuf[b]);
-                // munmap(csrbuf[b], blocksize_kb*1024);
-        }
+        if(arena != NULL) delete arena;
+        if(aliasarena != NULL) delete aliasarena;
         if(beg_posbuf != NULL) free(beg_posbuf);
         if(csrbuf != NULL) free(csrbuf);
+        if(aliasbuf != NULL) free(aliasbuf);
+        if(beg_posdf >= 0) close(beg_posdf);
+        if(csrdf >= 0) close(csrdf);
+        if(vcsrindex != NULL) free(vcsrindex);
+        if(vcsrf >= 0) close(vcsrf);
+        if(vcsrdf >= 0) close(vcsrdf);
+        if(aliasf >= 0) close(aliasf);
+        if(aliasdf >= 0) close(aliasdf);
+
+        if(aliasmap != NULL) munmap(aliasmap, aliasmap_sz);
+        if(beg_posmap != NULL) munmap(beg_posmap, beg_posmap_sz);
+        if(csrmap != NULL) munmap(csrmap, csrmap_sz);
 
         close(beg_posf);  
         close(csrf);  
     }
 
-    void load_block_range(std::string base_filename, unsigned long long blocksize_kb, vid_t * &blocks, bool allowfail=false) {
-        std::string blockrangefile = blockrangename(base_filename, blocksize_kb);
-        std::ifstream brf(blockrangefile.c_str());
-        
-        if (!brf.good()) {
-            logstream(LOG_ERROR) << "Could not load block range file: " << blockrangefile << std::endl;
+    /**
+     * Create an I/O backend for block loads, with the graph files and the
+     * csr slot buffers registered to it.
+     */
+    io_backend *open_io_backend(std::string name){
+        io_backend *bio = create_io_backend(name);
+        std::vector<int> fds;
+        fds.push_back(beg_posf);
+        fds.push_back(csrf);
+        if(loadmode == LOAD_DIRECT){
+            fds.push_back(beg_posdf);
+            fds.push_back(csrdf);
         }
-        assert(brf.good());
-        
-        blocks = (vid_t*)malloc((nblocks+1)*sizeof(vid_t));
-        vid_t en;
-        for(bid_t i=0; i < nblocks+1; i++) {
-            assert(!brf.eof());
-            brf >> en;
-            blocks[i] = en;
+        if(compressed){
+            fds.push_back(vcsrf);
+            if(vcsrdf >= 0) fds.push_back(vcsrdf);
+        }
+        if(weighted){
+            fds.push_back(aliasf);
+            if(aliasdf >= 0) fds.push_back(aliasdf);
+        }
+        bio->register_files(fds);
+        if(arena != NULL) bio->register_buffers(arena->csrSlabs());
+        return bio;
+    }
+
+    void initLoader(block_loader &ld, std::string iobackend){
+        ld.io = open_io_backend(iobackend);
+        ld.scratch = NULL;
+        ld.scratch_sz = 0;
+    }
+
+    void freeLoader(block_loader &ld){
+        delete ld.io;
+        if(ld.scratch != NULL) free(ld.scratch);
+    }
+
+    /**
+     * With option compressed, open the compressed csr written by
+     * compress_csr and load its block index. Blocks are then decoded into
+     * the csr slot buffers on load, so the walk kernels are unchanged.
+     */
+    void openCompressed(std::string invlname){
+        compressed = get_option_int("compressed", 0);
+        vcsrindex = NULL;
+        vcsrf = vcsrdf = -1;
+        if(!compressed) return;
+        if(loadmode == LOAD_MMAP){
+            logstream(LOG_WARNING) << "The compressed csr can not be mapped, load the raw csr." << std::endl;
+            compressed = false;
+            return;
+        }
+        std::string vcsrname = invlname + ".vcsr";
+        std::string indexname = vcsrindexname(base_filename, blocksize_kb);
+        vcsrf = open(vcsrname.c_str(), O_RDONLY);
+        int indexf = open(indexname.c_str(), O_RDONLY);
+        if (vcsrf < 0 || indexf < 0) {
+            logstream(LOG_FATAL) << "Could not load :" << vcsrname << " or " << indexname << ", error: " << strerror(errno) << std::endl;
+        }
+        assert(vcsrf > 0 && indexf > 0);
+        vcsrindex = (eid_t*)malloc((nblocks+1)*sizeof(eid_t));
+        preada(indexf, vcsrindex, (nblocks+1)*sizeof(eid_t), 0);
+        close(indexf);
+        vcsrf_sz = lseek(vcsrf, 0, SEEK_END);
+        if(loadmode == LOAD_DIRECT){
+            vcsrdf = open(vcsrname.c_str(), O_RDONLY | O_DIRECT);
+            if(vcsrdf < 0){
+                logstream(LOG_WARNING) << "Could not open " << vcsrname << " with O_DIRECT, error: " << strerror(errno) << std::endl;
+            }
+        }
+    }
+
+    /**
+     * With option weighted, open the edge alias tables written by
+     * compute_alias. They are read for each block along with its csr, from
+     * the same edge range, or mapped with loadmode mmap.
+     */
+    void openAlias(std::string invlname){
+        weighted = get_option_int("weighted", 0);
+        aliasf = aliasdf = -1;
+        aliasmap = NULL;
+        aliasmap_sz = 0;
+        if(!weighted) return;
+        std::string aliasname = invlname + ".alias";
+        aliasf = open(aliasname.c_str(), O_RDONLY);
+        if (aliasf < 0) {
+            logstream(LOG_FATAL) << "Could not load :" << aliasname << ", error: " << strerror(errno) << std::endl;
+        }
+        assert(aliasf > 0);
+        aliasf_sz = lseek(aliasf, 0, SEEK_END);
+        if(loadmode == LOAD_MMAP){
+            aliasmap_sz = aliasf_sz;
+            aliasmap = (alias_entry*)mmap(NULL, aliasmap_sz > 0 ? aliasmap_sz : 1, PROT_READ, MAP_SHARED, aliasf, 0);
+            if(aliasmap == MAP_FAILED){
+                logstream(LOG_FATAL) << "Could not mmap " << aliasname << ", error: " << strerror(errno) << std::endl;
+                assert(false);
+            }
+            madvise(aliasmap, aliasmap_sz, MADV_RANDOM);
+        }else if(loadmode == LOAD_DIRECT){
+            aliasdf = open(aliasname.c_str(), O_RDONLY | O_DIRECT);
+            if(aliasdf < 0){
+                logstream(LOG_WARNING) << "Could not open " << aliasname << " with O_DIRECT, error: " << strerror(errno) << std::endl;
+            }
+        }
+    }
+
+    /**
+     * Allocate the buffers of the nmblocks in memory slots up front, sized
+     * for the largest beg_pos and a blocksize_kb csr. With loadmode direct
+     * they are DIRECT_IO_ALIGN aligned, with room for the alignment padding,
+     * and locked in memory, so that the engine's own block cache is all the
+     * memory graph data takes.
+     */
+    void allocSlots(){
+        csrbuf = (vid_t**)malloc(nmblocks*sizeof(vid_t*));
+        beg_posbuf = (eid_t**)malloc(nmblocks*sizeof(eid_t*));
+        aliasbuf = (alias_entry**)malloc(nmblocks*sizeof(alias_entry*));
+        for(bid_t b = 0; b < nmblocks; b++){
+            csrbuf[b] = NULL;
+            beg_posbuf[b] = NULL;
+            aliasbuf[b] = NULL;
+        }
+        arena = NULL;
+        aliasarena = NULL;
+        if(loadmode == LOAD_MMAP) return; //slots point into the mapping once loaded
+        vid_t maxnverts = 0;
+        for(bid_t p = 0; p < nblocks; p++)
+            if(blocks[p+1] - blocks[p] > maxnverts) maxnverts = blocks[p+1] - blocks[p];
+        size_t beg_posslab_sz = (size_t)(maxnverts+1)*sizeof(eid_t);
+        size_t csrslab_sz = blocksize_kb*1024;
+        if(loadmode == LOAD_DIRECT){
+            beg_posslab_sz += 2*DIRECT_IO_ALIGN;
+            csrslab_sz += 2*DIRECT_IO_ALIGN;
+        }
+        arena = new block_arena(nmblocks, beg_posslab_sz, csrslab_sz, loadmode == LOAD_DIRECT ? DIRECT_IO_ALIGN : 0, loadmode == LOAD_DIRECT, hugepages);
+        if(weighted){ //only the csr slabs of this one are used, sized for the alias entries of a block
+            size_t aliasslab_sz = blocksize_kb*1024/sizeof(vid_t)*sizeof(alias_entry);
+            if(loadmode == LOAD_DIRECT) aliasslab_sz += 2*DIRECT_IO_ALIGN;
+            aliasarena = new block_arena(nmblocks, 0, aliasslab_sz, loadmode == LOAD_DIRECT ? DIRECT_IO_ALIGN : 0, loadmode == LOAD_DIRECT, hugepages);
+        }
+        logstream(LOG_INFO) << "csrbuf malloced!" << std::endl;
+    }
+
+    /**
+     * Read bytes [st, en) of a graph file into buf with O_DIRECT, returns
+     * where st landed in buf. The read is widened to DIRECT_IO_ALIGN, except
+     * for the unaligned tail of the file, which goes through the buffered fd.
+     */
+    size_t readDirect(io_backend *bio, int df, int f, size_t fsz, char *buf, size_t st, size_t en){
+        size_t ast = st & ~((size_t)DIRECT_IO_ALIGN-1);
+        size_t aen = (en + DIRECT_IO_ALIGN-1) & ~((size_t)DIRECT_IO_ALIGN-1);
+        size_t lim = fsz & ~((size_t)DIRECT_IO_ALIGN-1);
+        size_t den = aen < lim ? aen : (lim > ast ? lim : ast);
+        if(den > ast) bio->queue_read(df, buf, den - ast, ast);
+        if(en > den) bio->queue_read(f, buf + (den - ast), en - den, den);
+        bio->submit();
+        return st - ast;
+    }
+
+    /**
+     * Map the beg_pos and csr files once, findSubGraph then hands out
+     * pointers into the mapping. Access is random, read ahead is driven
+     * by the block cache through madvise instead.
+     */
+    void mapGraph(){
+        beg_posmap_sz = lseek(beg_posf, 0, SEEK_END);
+        csrmap_sz = lseek(csrf, 0, SEEK_END);
+        beg_posmap = (eid_t*)mmap(NULL, beg_posmap_sz, PROT_READ, MAP_SHARED, beg_posf, 0);
+        csrmap = (vid_t*)mmap(NULL, csrmap_sz > 0 ? csrmap_sz : 1, PROT_READ, MAP_SHARED, csrf, 0);
+        if(beg_posmap == MAP_FAILED || csrmap == MAP_FAILED){
+            logstream(LOG_FATAL) << "Could not mmap graph files, error: " << strerror(errno) << std::endl;
+            assert(false);
+        }
+        madvise(beg_posmap, beg_posmap_sz, MADV_RANDOM);
+        madvise(csrmap, csrmap_sz, MADV_RANDOM);
+        if(hugepages != HUGEPAGE_NONE) madvise(csrmap, csrmap_sz, MADV_HUGEPAGE); //only taken where the filesystem supports it
+    }
+
+    /**
+     * madvise the beg_pos and csr ranges of block p in the mapping.
+     */
+    void adviseBlock(bid_t p, int advice){
+        eid_t *beg_pos = beg_posmap + blocks[p];
+        vid_t nverts = blocks[p+1] - blocks[p];
+        madvise_range(beg_pos, (size_t)(nverts+1)*sizeof(eid_t), advice);
+        madvise_range(csrmap + beg_pos[0], (beg_pos[nverts] - beg_pos[0])*sizeof(vid_t), advice);
+    }
+
+    /**
+     * Give back the memory of block p, which is being evicted from slot.
+     */
+    void releaseSubGraph(bid_t p, bid_t slot){
+        if(loadmode == LOAD_MMAP){
+            adviseBlock(p, MADV_DONTNEED);
+            if(weighted) madvise_range(aliasmap + beg_posmap[blocks[p]], (beg_posmap[blocks[p+1]] - beg_posmap[blocks[p]])*sizeof(alias_entry), MADV_DONTNEED);
+        }else{
+            arena->release(slot);
+            if(weighted) aliasarena->release(slot);
+        }
+    }
+
+    void load_block_range(std::string base_filename, unsigned long long blocksize_kb, vid_t * &blocks, bool allowfail=false) {
+        std::string blockindexfile = blockindexname(base_filename, blocksize_kb);
+        if (!bindex.open(blockindexfile)) {
+            logstream(LOG_ERROR) << "Could not load block index file: " << blockindexfile << std::endl;
         }
+        assert(bindex.hdr != NULL && bindex.hdr->nblocks == nblocks);
+        blocks = bindex.blocks;
         for(bid_t i=nblocks-1; i < nblocks; i++) {
              logstream(LOG_INFO) << "last shard: " << blocks[i] << " - " << blocks[i+1] << std::endl;
         }
-        brf.close();
     }
 
-    void loadSubGraph(bid_t p, eid_t * &beg_pos, vid_t * &csr, vid_t *nverts, eid_t *nedges){
+    void loadSubGraph(bid_t p, bid_t slot, vid_t *nverts, eid_t *nedges){
         m.start_time("g_loadSubGraph");
-        
+        readSubGraph(p, slot, loader, nverts, nedges);
+        m.stop_time("g_loadSubGraph");
+    }
+
+    /**
+     * Read block p into the in memory slot with loader ld. Also called from
+     * the prefetch thread, so only the thread-safe metrics calls are used here.
+     */
+    void readSubGraph(bid_t p, bid_t slot, block_loader &ld, vid_t *nverts, eid_t *nedges){
+        io_backend *bio = ld.io;
+        eid_t * &beg_pos = beg_posbuf[slot];
+        vid_t * &csr = csrbuf[slot];
+
+        if(loadmode == LOAD_MMAP){
+            *nverts = blocks[p+1] - blocks[p];
+            beg_pos = beg_posmap + blocks[p];
+            csr = csrmap + beg_pos[0];
+            *nedges = beg_pos[*nverts] - beg_pos[0];
+            adviseBlock(p, MADV_WILLNEED);
+            if(weighted){
+                aliasbuf[slot] = aliasmap + beg_pos[0];
+                madvise_range(aliasbuf[slot], (*nedges)*sizeof(alias_entry), MADV_WILLNEED);
+            }
+            return;
+        }
+        if(loadmode == LOAD_DIRECT){
+            readSubGraphDirect(p, slot, ld, nverts, nedges);
+            if(weighted) readAlias(slot, ld, beg_posbuf[slot][0], *nedges);
+            return;
+        }
 
         // m.start_time("__g_loadSubGraph_malloc_begpos");
         /* read beg_pos file */
         *nverts = blocks[p+1] - blocks[p];
-        beg_pos = (eid_t*) malloc((*nverts+1)*sizeof(eid_t));
+        beg_pos = (eid_t*)arena->beg_pos(slot);
         // m.stop_time("__g_loadSubGraph_malloc_begpos");
         // beg_pos=(eid_t *)mmap(NULL,(size_t)(*nverts+1)*sizeof(eid_t),
         //         PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
@@ -182,19 +561,22 @@ public:
         //     perror("beg_pos alloc mmap");
         //     exit(-1);
         // }
-        m.start_time("z__g_loadSubGraph_read_begpos");
-        preada(beg_posf, beg_pos, (size_t)(*nverts+1)*sizeof(eid_t), (size_t)blocks[p]*sizeof(eid_t));        
-        m.stop_time("z__g_loadSubGraph_read_begpos");
+        metrics_entry me = m.start_time();
+        bio->read(beg_posf, beg_pos, (size_t)(*nverts+1)*sizeof(eid_t), (size_t)blocks[p]*sizeof(eid_t));
+        m.stop_time(me, "z__g_loadSubGraph_read_begpos");
         /* read csr file */
-        m.start_time("z__g_loadSubGraph_realloc_csr");
+        me = m.start_time();
         *nedges = beg_pos[*nverts] - beg_pos[0];
-        if(*nedges*sizeof(vid_t) > blocksize_kb*1024){
-            csr = (vid_t*)realloc(csr, (*nedges)*sizeof(vid_t) );
+        csr = (vid_t*)arena->csr(slot, (*nedges)*sizeof(vid_t));
+        m.stop_time(me, "z__g_loadSubGraph_realloc_csr");     
+        if(weighted) readAlias(slot, ld, beg_pos[0], *nedges);
+        if(compressed){
+            readCompressed(p, ld, beg_pos, *nverts, csr);
+            return;
         }
-        m.stop_time("z__g_loadSubGraph_realloc_csr");     
-        m.start_time("z__g_loadSubGraph_read_csr");
-        preada(csrf, csr, (*nedges)*sizeof(vid_t), beg_pos[0]*sizeof(vid_t));
-        m.stop_time("z__g_loadSubGraph_read_csr");     
+        me = m.start_time();
+        bio->read(csrf, csr, (*nedges)*sizeof(vid_t), beg_pos[0]*sizeof(vid_t));
+        m.stop_time(me, "z__g_loadSubGraph_read_csr");     
 
         /*output load graph info*/
         // logstream(LOG_INFO) << "LoadSubGraph data end, with nverts = " << *nverts << ", " << "nedges = " << *nedges << std::endl;
@@ -205,7 +587,73 @@ public:
         // logstream(LOG_INFO) << "csr : "<< std::endl;
         // for(eid_t i = *nedges-10; i < *nedges; i++)
         //     logstream(LOG_INFO) << "csr[" << i << "] = " << csr[i] << ", "<< std::endl;
-        m.stop_time("g_loadSubGraph");
+    }
+
+    void readSubGraphDirect(bid_t p, bid_t slot, block_loader &ld, vid_t *nverts, eid_t *nedges){
+        io_backend *bio = ld.io;
+        *nverts = blocks[p+1] - blocks[p];
+        metrics_entry me = m.start_time();
+        size_t st = (size_t)blocks[p]*sizeof(eid_t);
+        size_t off = readDirect(bio, beg_posdf, beg_posf, beg_posf_sz, arena->beg_pos(slot), st, st + (size_t)(*nverts+1)*sizeof(eid_t));
+        eid_t *beg_pos = (eid_t*)(arena->beg_pos(slot) + off);
+        beg_posbuf[slot] = beg_pos;
+        m.stop_time(me, "z__g_loadSubGraph_read_begpos");
+        *nedges = beg_pos[*nverts] - beg_pos[0];
+        if(compressed){
+            csrbuf[slot] = (vid_t*)arena->csr(slot, (*nedges)*sizeof(vid_t));
+            readCompressed(p, ld, beg_pos, *nverts, csrbuf[slot]);
+            return;
+        }
+        me = m.start_time();
+        st = beg_pos[0]*sizeof(vid_t);
+        char *buf = arena->csr(slot, (*nedges)*sizeof(vid_t) + 2*DIRECT_IO_ALIGN);
+        off = readDirect(bio, csrdf, csrf, csrf_sz, buf, st, st + (*nedges)*sizeof(vid_t));
+        csrbuf[slot] = (vid_t*)(buf + off);
+        m.stop_time(me, "z__g_loadSubGraph_read_csr");
+    }
+
+    /**
+     * Read the alias entries of the nedges edges from edge st into slot.
+     */
+    void readAlias(bid_t slot, block_loader &ld, eid_t st, eid_t nedges){
+        metrics_entry me = m.start_time();
+        size_t nbytes = nedges*sizeof(alias_entry);
+        if(aliasdf >= 0){
+            char *buf = aliasarena->csr(slot, nbytes + 2*DIRECT_IO_ALIGN);
+            size_t off = readDirect(ld.io, aliasdf, aliasf, aliasf_sz, buf, st*sizeof(alias_entry), st*sizeof(alias_entry) + nbytes);
+            aliasbuf[slot] = (alias_entry*)(buf + off);
+        }else{
+            aliasbuf[slot] = (alias_entry*)aliasarena->csr(slot, nbytes);
+            ld.io->read(aliasf, aliasbuf[slot], nbytes, st*sizeof(alias_entry));
+        }
+        m.stop_time(me, "z__g_loadSubGraph_read_alias");
+    }
+
+    /**
+     * Read the compressed csr of block p into the loader's scratch buffer
+     * and decode it into csr.
+     */
+    void readCompressed(bid_t p, block_loader &ld, eid_t *beg_pos, vid_t nverts, vid_t *csr){
+        metrics_entry me = m.start_time();
+        size_t st = vcsrindex[p], en = vcsrindex[p+1];
+        size_t nbytes = en - st + 2*DIRECT_IO_ALIGN;
+        if(nbytes > ld.scratch_sz){
+            if(ld.scratch != NULL) free(ld.scratch);
+            ld.scratch = arena->alloc(nbytes);
+            ld.scratch_sz = nbytes;
+        }
+        const unsigned char *in = (unsigned char*)ld.scratch;
+        if(vcsrdf >= 0){
+            in += readDirect(ld.io, vcsrdf, vcsrf, vcsrf_sz, ld.scratch, st, en);
+        }else{
+            ld.io->read(vcsrf, ld.scratch, en - st, st);
+        }
+        m.stop_time(me, "z__g_loadSubGraph_read_csr");
+        me = m.start_time();
+        for(vid_t v = 0; v < nverts; v++){
+            decode_adjacency(blocks[p]+v, in, beg_pos[v+1]-beg_pos[v], csr + beg_pos[v]-beg_pos[0]);
+        }
+        m.stop_time(me, "z__g_loadSubGraph_decode_csr");
     }
 
     void findSubGraph(bid_t p, eid_t * &beg_pos, vid_t * &csr, vid_t *nverts, eid_t *nedges){
@@ -216,63 +664,172 @@ public:
             if(cmblocks < nmblocks){
                 swapin = cmblocks++;
             }else{
-                bid_t minmwb = swapOut();
+                bid_t minmwb = swapOut(p);
+                assert(minmwb < nblocks);
                 swapin = inMemIndex[minmwb];
                 inMemIndex[minmwb] = nmblocks;
                 assert(swapin < nmblocks);
-                if(beg_posbuf[swapin] != NULL) free(beg_posbuf[swapin]);
+                cache->erase(minmwb);
+                releaseSubGraph(minmwb, swapin);
                     // munmap(beg_posbuf[swapin], sizeof(eid_t)*(blocks[minmwb+1] - blocks[minmwb] + 1));
             }
-            loadSubGraph(p, beg_posbuf[swapin], csrbuf[swapin], nverts, nedges);
+            loadSubGraph(p, swapin, nverts, nedges);
             inMemIndex[p] = swapin;
-        }else{
-            // logstream(LOG_INFO) << "Oh yeah! Block " << p << " is in memory!" << std::endl;
+            cache->insert(p);
+        }else if(nprefetch > 0){
+            waitSlot(inMemIndex[p]);
         }
         beg_pos = beg_posbuf[ inMemIndex[p] ];
         csr = csrbuf[ inMemIndex[p] ];
+        *nverts = blocks[p+1] - blocks[p];
+        *nedges = beg_pos[*nverts] - beg_pos[0];
+        cache->touch(p, (size_t)(*nverts+1)*sizeof(eid_t) + (*nedges)*(sizeof(vid_t) + (weighted ? sizeof(alias_entry) : 0)));
         m.stop_time("2_findSubGraph");
     }
 
-    bid_t swapOut(){
-        m.start_time("z_g_swapOut");
-        wid_t minmw = 0xffffffff;
-        bid_t minmwb = 0;
-        for(bid_t b = 0; b < nblocks; b++){
-            if(inMemIndex[b]<nmblocks && walk_manager->walknum[b] < minmw){
-                minmw = walk_manager->walknum[b];
-                minmwb = b;
-            }
+    /* blocks swapOut must not choose */
+    struct swap_filter : public evict_filter {
+        graphwalker_engine *engine;
+        bid_t keep;
+        swap_filter(graphwalker_engine *_engine, bid_t _keep) : engine(_engine), keep(_keep) {}
+        bool evictable(bid_t b){
+            return b != keep && !engine->loading[engine->inMemIndex[b]];
         }
+    };
+
+    /**
+     * Choose the in-memory block to be evicted with the cache policy,
+     * skipping block keep and slots the prefetch thread is still filling.
+     * Returns nblocks if there is no such block.
+     */
+    bid_t swapOut(bid_t keep){
+        m.start_time("z_g_swapOut");
+        swap_filter filter(this, keep);
+        bid_t minmwb = cache->victim(filter);
         // logstream(LOG_DEBUG) << "block " << minmwb << " is chosen to swap out!" << std::endl;
         // bid_t res = inMemIndex[minmwb];
         // inMemIndex[minmwb] = nmblocks;
-        m.start_time("z_g_swapOut");
+        m.stop_time("z_g_swapOut");
         return minmwb;
     }
 
+    /**
+     * Wait until the prefetch thread has finished filling slot.
+     */
+    void waitSlot(bid_t slot){
+        m.start_time("z_g_waitPrefetch");
+        prefetch_lock.lock();
+        while(loading[slot]) prefetch_cond.wait(prefetch_lock);
+        prefetch_lock.unlock();
+        m.stop_time("z_g_waitPrefetch");
+    }
+
+    static void *prefetch_loop(void *arg){
+        graphwalker_engine *engine = (graphwalker_engine*)arg;
+        vid_t nverts;
+        eid_t nedges;
+        engine->prefetch_lock.lock();
+        while(true){
+            while(engine->prefetch_queue.empty() && !engine->prefetch_stop)
+                engine->prefetch_cond.wait(engine->prefetch_lock);
+            if(engine->prefetch_queue.empty()) break;
+            std::pair<bid_t, bid_t> req = engine->prefetch_queue.front();
+            engine->prefetch_queue.pop_front();
+            engine->prefetch_lock.unlock();
+            engine->readSubGraph(req.first, req.second, engine->prefetch_loader, &nverts, &nedges);
+            engine->prefetch_lock.lock();
+            engine->loading[req.second] = false;
+            engine->prefetch_cond.broadcast();
+        }
+        engine->prefetch_lock.unlock();
+        return NULL;
+    }
+
+    /**
+     * Hand the blocks most likely to be chosen after exec_block to the
+     * prefetch thread, so they load while exec_block is being executed.
+     * A resident block is only evicted for a block holding more walks.
+     */
+    void prefetchBlocks(bid_t exec_block){
+        if(nprefetch == 0) return;
+        m.start_time("z_g_prefetchBlocks");
+        std::vector<bid_t> pred(nprefetch);
+        bid_t npred = walk_manager->predictBlocks(exec_block, nprefetch, &pred[0]);
+        for(bid_t i = 0; i < npred; i++){
+            bid_t p = pred[i];
+            if(inMemIndex[p] < nmblocks) continue;
+            bid_t swapin;
+            if(cmblocks < nmblocks){
+                swapin = cmblocks++;
+            }else{
+                bid_t minmwb = swapOut(exec_block);
+                if(minmwb == nblocks || walk_manager->walknum[minmwb] >= walk_manager->walknum[p]) break;
+                swapin = inMemIndex[minmwb];
+                inMemIndex[minmwb] = nmblocks;
+                cache->erase(minmwb);
+                releaseSubGraph(minmwb, swapin);
+            }
+            inMemIndex[p] = swapin;
+            cache->insert(p);
+            prefetch_lock.lock();
+            loading[swapin] = true;
+            prefetch_queue.push_back(std::make_pair(p, swapin));
+            prefetch_cond.signal();
+            prefetch_lock.unlock();
+        }
+        m.stop_time("z_g_prefetchBlocks");
+    }
+
     virtual size_t num_vertices() {
         return blocks[nblocks];
     }
 
-    void exec_updates(RandomWalk &userprogram, wid_t nwalks, eid_t *&beg_pos, vid_t *&csr){ //, VertexDataType* vertex_value){
+    template <class Program>
+    void exec_updates(Program &userprogram, wid_t nwalks, eid_t *&beg_pos, vid_t *&csr){ //, VertexDataType* vertex_value){
         // unsigned count = walk_manager->readblockWalks(exec_block);
         m.start_time("5_exec_updates");
         if(nwalks < 100) omp_set_num_threads(1);
+        if(interleave > 0){
+            /* batches of a few per thread, each stepped interleaved */
+            wid_t batch = nwalks / (4*exec_threads) + 1;
+            if(batch < interleave) batch = interleave;
+            #pragma omp parallel for schedule(dynamic, 1)
+                for(wid_t i = 0; i < nwalks; i += batch){
+                    wid_t n = nwalks - i < batch ? nwalks - i : batch;
+                    userprogram.updateByWalks(walk_manager->curwalks + i, n, i, exec_block, beg_pos, csr, *walk_manager);
+                }
+        }else{
         #pragma omp parallel for schedule(static)
             for(wid_t i = 0; i < nwalks; i++ ){
                 // logstream(LOG_INFO) << "exec_block : " << exec_block << " , walk : " << i << " --> threads." << omp_get_thread_num() << std::endl;
                 WalkDataType walk = walk_manager->curwalks[i];
                 userprogram.updateByWalk(walk, i, exec_block, beg_pos, csr, *walk_manager );//, vertex_value);
             }
+        }
         // logstream(LOG_INFO) << "exec_updates end. Processsed walks with exec_threads = " << (int)exec_threads << std::endl;
         m.stop_time("5_exec_updates");
         // walk_manager->writeblockWalks(exec_block);
     }
 
-    void run(RandomWalk &userprogram, float prob) {
+    /* instantiated for the app's own type, so a final one's updates are direct calls */
+    template <class Program>
+    void run(Program &userprogram, float prob) {
         // srand((unsigned)time(NULL));
+        userprogram.hot = hot.size() > 0 ? &hot : NULL;
+        userprogram.bloom = bloom.loaded() ? &bloom : NULL;
+        userprogram.interleave = interleave;
+        userprogram.initRng(exec_threads, get_option_long("seed", time(NULL)));
         m.start_time("0_startWalks");
-        userprogram.startWalks(*walk_manager, nblocks, blocks, base_filename);
+        int blockcount = 0;
+        if(walk_manager->resumed){
+            userprogram.nblocks = nblocks;
+            userprogram.blocks = blocks;
+            walk_manager->loadState(userprogram.state);
+            blockcount = walk_manager->ckpt.blockcount;
+        }else{
+            userprogram.startWalks(*walk_manager, nblocks, blocks, base_filename);
+        }
+        walk_manager->walksStarted();
         m.stop_time("0_startWalks");
         
         gettimeofday(&start, NULL);
@@ -280,22 +837,25 @@ public:
 
         vid_t nverts, *csr;
         eid_t nedges, *beg_pos;
+        double lastcheckpoint = 0;
         /*loadOnDemand -- block loop */
-        int blockcount = 0;
         while( userprogram.hasFinishedWalk(*walk_manager) ){
             blockcount++;
             m.start_time("1_chooseBlock");
             exec_block = walk_manager->chooseBlock(prob);
             m.stop_time("1_chooseBlock");
             findSubGraph(exec_block, beg_pos, csr, &nverts, &nedges);
+            userprogram.alias = weighted ? aliasbuf[inMemIndex[exec_block]] : NULL;
 
             /*load walks info*/
             // walk_manager->loadWalkPool(exec_block);
             wid_t nwalks; 
             nwalks = walk_manager->getCurrentWalks(exec_block);
+            prefetchBlocks(exec_block);
+            if(sortwalks) walk_manager->sortWalks(nwalks, nverts);
             
             // if(blockcount % (nblocks/100+1)==1)
-            if(blockcount % (1024*1024*1024/nedges+1) == 1)
+            if(blockcount % (1024*1024*1024/(nedges+1)+1) == 1)
             {
                 logstream(LOG_DEBUG) << runtime() << "s : blockcount: " << blockcount << std::endl;
                 logstream(LOG_INFO) << "nverts = " << nverts << ", nedges = " << nedges << std::endl;
@@ -304,10 +864,16 @@ public:
             
             exec_updates(userprogram, nwalks, beg_pos, csr);
             walk_manager->updateWalkNum(exec_block);
+            for(size_t i = 0; i < walk_manager->recounted.size(); i++)
+                cache->recount(walk_manager->recounted[i]);
+            if(checkpoint_sec > 0 && runtime() - lastcheckpoint >= checkpoint_sec
+                && walk_manager->checkpoint(blockcount, userprogram.state))
+                lastcheckpoint = runtime();
             // userprogram.compUtilization(beg_pos[nverts] - beg_pos[0]);
 
         } // For block loop
         m.stop_time("00_runtime");
+        walk_manager->removeCheckpoint();
     }
 };
 
@@ -195,18 +195,22 @@
     }
     
     inline void add_to_vector(std::string key, double value) {
+        mlock.lock();
        if (entries.count(key) == 0) {
          entries[key] = metrics_entry(value, VECTOR);
        } else {
          entries[key].add(value);
        }
+        mlock.unlock();
     }
 
     inline void add_vector_entry(std::string key, size_t idx, double value) {
+        mlock.lock();
        if (entries.count(key) == 0) {
          entries[key] = metrics_entry(VECTOR);
        }
        entries[key].add_vector_entry(idx, value);
+        mlock.unlock();
     }
     
     inline void set(std::string key, size_t value) {
@@ -219,27 +223,33 @@
       }  
       
     inline void set(std::string key, double value, metrictype type = REAL) {
+        mlock.lock();
       if (entries.count(key) == 0) {
         entries[key] = metrics_entry(value, type);
       } else {
         entries[key].set(value);
       }
+        mlock.unlock();
     }
     
     inline void set_integer(std::string key, size_t value) {
+        mlock.lock();
       if (entries.count(key) == 0) {
         entries[key] = metrics_entry((double)value, INTEGER);
       } else {
         entries[key].set((double)value);
       }
+        mlock.unlock();
     }
     
     inline void set(std::string key, std::string s) {
+        mlock.lock();
       if (entries.count(key) == 0) {
         entries[key] = metrics_entry(s);
       } else {
         entries[key].set(s);
       }
+        mlock.unlock();
     }
 
     inline void set_vector_entry_integer(std::string key, size_t idx, size_t value) {
@@ -315,13 +325,18 @@
       
       
       inline void stop_time(std::string key, bool show = false) {
+          mlock.lock();
           entries[key].timer_stop();
           if (show) 
               std::cout << key << ": " << entries[key].lasttime << " secs." << std::endl;
+          mlock.unlock();
       }
         
     inline metrics_entry get(std::string key) {
-      return entries[key];
+        mlock.lock();
+        metrics_entry me = entries[key];
+        mlock.unlock();
+        return me;
     }
       
       
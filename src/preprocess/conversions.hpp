@@ -10,11 +10,18 @@
 
 #include <fstream>
 #include <iostream>
+#include <map>
 
 #include "api/datatype.hpp"
 #include "logger/logger.hpp"
 #include "api/filename.hpp"
 #include "api/io.hpp"
+#include "api/blockindex.hpp"
+#include "api/hotvertices.hpp"
+#include "api/edgealias.hpp"
+#include "api/nbrbloom.hpp"
+#include "api/cmdopts.hpp"
+#include "util/varint.hpp"
 
     long long max_value(long long a, long long b){
         return (a > b ? a : b);
@@ -107,17 +114,9 @@
      * 0 if not found.
      */
     static bid_t find_blockrange(std::string base_filename, unsigned long long blocksize_kb) {
-        std::string blockrangefile = blockrangename(base_filename, blocksize_kb);
-        FILE *tryf = fopen(blockrangefile.c_str(), "r");
-        if (tryf != NULL) { // Found!
-            bid_t nblocks = 0;
-            while(!feof(tryf)){
-                char flag = fgetc(tryf);
-                if(flag == '\n')
-                nblocks++;
-            }
-            fclose(tryf);
-            return nblocks-1;
+        block_index index;
+        if (index.open(blockindexname(base_filename, blocksize_kb))) { // Found!
+            return index.hdr->nblocks;
         }
         // Not found!
         logstream(LOG_WARNING) << "Could not find blocks with blocksize = " << blocksize_kb << "KB." << std::endl;
@@ -303,9 +302,11 @@
         
         bid_t blockid = 0;
         std::vector<vid_t> blocks;
+        std::vector<eid_t> offs; //beg_pos of the start vertex of each block
         vid_t stvb= 0; //start vertex of current block
         eid_t bgstvb= 0; //beg_pos of the start vertex of current block
         blocks.push_back(stvb);
+        offs.push_back(bgstvb);
 
         eid_t * beg_pos = (eid_t*) malloc(VERT_SIZE*sizeof(eid_t));
         std::string beg_posname = fidname(filename,fid) + ".beg_pos";
@@ -335,14 +336,17 @@
                         blockid+=2;
                         stvb = nread+v-1;
                         blocks.push_back(stvb);
+                        offs.push_back(beg_pos[v-1]);
                         stvb = nread+v;
                         blocks.push_back(stvb);
                         bgstvb = beg_pos[v];
+                        offs.push_back(bgstvb);
                     }else{
                         blockid++;
                         stvb = nread+v-1;
                         blocks.push_back(stvb);
                         bgstvb = beg_pos[v-1];
+                        offs.push_back(bgstvb);
                     }
                 }
             }
@@ -350,19 +354,294 @@
         }
         close(beg_posf);
         blocks.push_back(ttv-1);
+        offs.push_back(beg_pos[rv-1]);
         blockid++;
+        free(beg_pos);
 
-        /*write block range*/
-        std::string blockrangefile = blockrangename(filename, blocksize_kb);
-        std::ofstream brf(blockrangefile.c_str());      
-        for( bid_t p = 0; p < blocks.size(); p++ ){
-            brf << blocks[p] << std::endl;
-        }
-        brf.close();
+        /*write block index*/
+        write_block_index(blockindexname(filename, blocksize_kb), blocks, offs);
 
         return blockid;
     }
 
+    /**
+     * Write the compressed csr file_0.vcsr, the adjacency of every vertex
+     * as varint deltas, and the byte offset of every block in it. The .vcsr
+     * does not depend on the blocksize and is only written once.
+     */
+    void compress_csr(std::string filename, unsigned long long blocksize_kb){
+        block_index bindex;
+        bool found = bindex.open(blockindexname(filename, blocksize_kb));
+        assert(found);
+        vid_t *blocks = bindex.blocks;
+        bid_t nblocks = bindex.hdr->nblocks;
+
+        std::string fidfile = fidname(filename, 0);
+        std::string vcsrname = fidfile + ".vcsr";
+        bool exists = access(vcsrname.c_str(), F_OK) == 0;
+        int beg_posf = open((fidfile + ".beg_pos").c_str(), O_RDONLY);
+        int csrf = open((fidfile + ".csr").c_str(), O_RDONLY);
+        int vcsrf = exists ? -1 : open(vcsrname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+        if (beg_posf < 0 || csrf < 0 || (!exists && vcsrf < 0)) {
+            logstream(LOG_FATAL) << "Could not compress :" << fidfile << ", error: " << strerror(errno) << std::endl;
+        }
+        assert(beg_posf > 0 && csrf > 0 && (exists || vcsrf > 0));
+
+        std::vector<eid_t> index;
+        index.push_back(0);
+        for(bid_t p = 0; p < nblocks; p++){
+            vid_t nverts = blocks[p+1] - blocks[p];
+            eid_t *beg_pos = (eid_t*)malloc((nverts+1)*sizeof(eid_t));
+            preada(beg_posf, beg_pos, (size_t)(nverts+1)*sizeof(eid_t), (size_t)blocks[p]*sizeof(eid_t));
+            eid_t nedges = beg_pos[nverts] - beg_pos[0];
+            vid_t *csr = (vid_t*)malloc(nedges*sizeof(vid_t) + 1);
+            preada(csrf, csr, nedges*sizeof(vid_t), beg_pos[0]*sizeof(vid_t));
+            unsigned char *out = (unsigned char*)malloc(adjacency_bound(nedges) + 1);
+            size_t nbytes = 0;
+            for(vid_t v = 0; v < nverts; v++){
+                nbytes += encode_adjacency(blocks[p]+v, csr + beg_pos[v]-beg_pos[0], beg_pos[v+1]-beg_pos[v], out + nbytes);
+            }
+            if(!exists) pwritea(vcsrf, out, nbytes, index.back());
+            index.push_back(index.back() + nbytes);
+            free(out);
+            free(csr);
+            free(beg_pos);
+        }
+        eid_t rawsize = lseek(csrf, 0, SEEK_END);
+        close(beg_posf);
+        close(csrf);
+        if(!exists) close(vcsrf);
+
+        std::string indexname = vcsrindexname(filename, blocksize_kb);
+        int indexf = open(indexname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+        assert(indexf >= 0);
+        pwritea(indexf, &index[0], index.size()*sizeof(eid_t));
+        close(indexf);
+        logstream(LOG_INFO) << "Compressed csr : " << index.back() << " bytes, " << (float)rawsize/(index.back()+1) << "x smaller than the .csr" << std::endl;
+    }
+
+    /**
+     * Write the hot vertex store: rank the vertices by in degree, as that is
+     * how often walks arrive at them, and keep the adjacency of the highest
+     * ones until hotcache_kb is spent. A histogram of the in degrees finds
+     * the cut, so the ranking takes no memory beyond the in degree counts.
+     */
+    void compute_hotvertices(std::string filename, unsigned long long hotcache_kb){
+        size_t budget = (size_t)hotcache_kb * 1024;
+        std::string fidfile = fidname(filename, 0);
+        int beg_posf = open((fidfile + ".beg_pos").c_str(), O_RDONLY);
+        int csrf = open((fidfile + ".csr").c_str(), O_RDONLY);
+        if (beg_posf < 0 || csrf < 0) {
+            logstream(LOG_FATAL) << "Could not load :" << fidfile << ", error: " << strerror(errno) << std::endl;
+        }
+        assert(beg_posf > 0 && csrf > 0);
+        vid_t nverts = lseek(beg_posf, 0, SEEK_END) / sizeof(eid_t) - 1;
+        eid_t nedges = lseek(csrf, 0, SEEK_END) / sizeof(vid_t);
+
+        vid_t *indeg = (vid_t*) calloc(nverts, sizeof(vid_t));
+        vid_t *csr = (vid_t*) malloc((nedges < EDGE_SIZE ? nedges : EDGE_SIZE)*sizeof(vid_t) + 1);
+        for(eid_t nread = 0; nread < nedges; ){
+            eid_t re = nedges - nread < EDGE_SIZE ? nedges - nread : EDGE_SIZE;
+            preada(csrf, csr, re*sizeof(vid_t), nread*sizeof(vid_t));
+            for(eid_t e = 0; e < re; e++) indeg[csr[e]]++;
+            nread += re;
+        }
+        free(csr);
+
+        /* bytes the vertices of each in degree take in the store */
+        std::map<vid_t, size_t> hist;
+        vid_t thr = 0; //lowest in degree kept
+        size_t left = 0; //budget left for the vertices of in degree thr
+        std::vector<vid_t> ids;
+        eid_t *beg_pos = (eid_t*) malloc(VERT_SIZE*sizeof(eid_t));
+        for(int pass = 0; pass < 2; pass++){
+            vid_t nread = 0;
+            while(nread < nverts){
+                vid_t rv = nverts - nread + 1 < VERT_SIZE ? nverts - nread + 1 : VERT_SIZE; //overlap a vertex to get the last out degree
+                preada(beg_posf, beg_pos, (size_t)rv*sizeof(eid_t), (size_t)nread*sizeof(eid_t));
+                for(vid_t v = 0; v + 1 < rv; v++){
+                    eid_t outd = beg_pos[v+1] - beg_pos[v];
+                    vid_t ind = indeg[nread+v];
+                    if(outd == 0 || ind == 0 || ind < thr) continue;
+                    size_t each = outd*sizeof(vid_t) + sizeof(vid_t) + sizeof(eid_t);
+                    if(pass == 0){
+                        hist[ind] += each;
+                    }else if(ind > thr){
+                        ids.push_back(nread+v);
+                    }else if(each <= left){
+                        ids.push_back(nread+v);
+                        left -= each;
+                    }
+                }
+                nread += rv - 1;
+            }
+            if(pass > 0) break;
+            size_t used = sizeof(eid_t);
+            thr = (vid_t)-1;
+            for(std::map<vid_t, size_t>::reverse_iterator it = hist.rbegin(); it != hist.rend() && used < budget; it++){
+                thr = it->first;
+                left = budget - used;
+                used += it->second;
+            }
+        }
+        free(beg_pos);
+        free(indeg);
+
+        std::vector<eid_t> offs;
+        std::vector<vid_t> adj;
+        offs.push_back(0);
+        for(size_t i = 0; i < ids.size(); i++){
+            eid_t range[2];
+            preada(beg_posf, range, 2*sizeof(eid_t), (size_t)ids[i]*sizeof(eid_t));
+            adj.resize(offs.back() + range[1] - range[0]);
+            preada(csrf, &adj[offs.back()], (range[1] - range[0])*sizeof(vid_t), range[0]*sizeof(vid_t));
+            offs.push_back(adj.size());
+        }
+        close(beg_posf);
+        close(csrf);
+
+        write_hot_vertices(hotverticesname(filename, hotcache_kb), nverts, ids, offs, adj);
+        logstream(LOG_INFO) << "Hot vertex store : " << ids.size() << " vertices of in degree >= " << thr << ", " << adj.size() << " edges" << std::endl;
+    }
+
+    /**
+     * Write the neighbor Bloom filters of the blocks, bits_per_edge bits for
+     * every edge, for second order walks to test the edges of a vertex whose
+     * block is not in memory.
+     */
+    void compute_neighbor_bloom(std::string filename, unsigned long long blocksize_kb, unsigned bits_per_edge){
+        block_index bindex;
+        bool found = bindex.open(blockindexname(filename, blocksize_kb));
+        assert(found);
+        vid_t *blocks = bindex.blocks;
+        bid_t nblocks = bindex.hdr->nblocks;
+
+        std::string fidfile = fidname(filename, 0);
+        int beg_posf = open((fidfile + ".beg_pos").c_str(), O_RDONLY);
+        int csrf = open((fidfile + ".csr").c_str(), O_RDONLY);
+        if (beg_posf < 0 || csrf < 0) {
+            logstream(LOG_FATAL) << "Could not load :" << fidfile << ", error: " << strerror(errno) << std::endl;
+        }
+        assert(beg_posf > 0 && csrf > 0);
+
+        uint32_t nhashes = neighbor_bloom_nhashes(bits_per_edge);
+        std::vector<uint64_t> offs, words;
+        offs.push_back(0);
+        for(bid_t p = 0; p < nblocks; p++){
+            vid_t nverts = blocks[p+1] - blocks[p];
+            eid_t *beg_pos = (eid_t*)malloc((nverts+1)*sizeof(eid_t));
+            preada(beg_posf, beg_pos, (size_t)(nverts+1)*sizeof(eid_t), (size_t)blocks[p]*sizeof(eid_t));
+            eid_t nedges = beg_pos[nverts] - beg_pos[0];
+            vid_t *csr = (vid_t*)malloc(nedges*sizeof(vid_t) + 1);
+            preada(csrf, csr, nedges*sizeof(vid_t), beg_pos[0]*sizeof(vid_t));
+            size_t nwords = neighbor_bloom_words(nedges, bits_per_edge);
+            words.resize(offs.back() + nwords, 0);
+            for(vid_t v = 0; v < nverts; v++)
+                for(eid_t e = beg_pos[v]; e < beg_pos[v+1]; e++)
+                    neighbor_bloom_add(&words[offs.back()], nwords, nhashes, blocks[p]+v, csr[e-beg_pos[0]]);
+            offs.push_back(offs.back() + nwords);
+            free(csr);
+            free(beg_pos);
+        }
+        close(beg_posf);
+        close(csrf);
+
+        write_neighbor_bloom(neighborbloomname(filename, blocksize_kb, bits_per_edge), bits_per_edge, offs, words);
+        logstream(LOG_INFO) << "Neighbor Bloom filters : " << words.size()*sizeof(uint64_t) << " bytes, " << nhashes << " bits per edge set" << std::endl;
+    }
+
+    /**
+     * Write file_0.weight, the weight of every edge as a float in csr order,
+     * from the third column of the edge list, 1 where it has none. The edge
+     * list is read again with the same rules as convert_to_csr, so the
+     * weights line up with the csr.
+     */
+    void write_edge_weights(std::string filename){
+        FILE * inf = fopen(filename.c_str(), "r");
+        std::string weightname = fidname(filename, 0) + ".weight";
+        int weightf = open(weightname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+        if (inf == NULL || weightf < 0) {
+            logstream(LOG_FATAL) << "Could not load :" << filename << " or " << weightname << " error: " << strerror(errno) << std::endl;
+        }
+        assert(inf != NULL && weightf >= 0);
+        float * weight = (float*) malloc(EDGE_SIZE*sizeof(float));
+        eid_t nbuf = 0, nedges = 0;
+        char s[1024];
+        while(fgets(s, 1024, inf) != NULL) {
+            if (s[0] == '#') continue; // Comment
+            if (s[0] == '%') continue; // Comment
+            char *t1, *t2, *t3;
+            t1 = strtok(s, "\t, ");
+            t2 = strtok(NULL, "\t, ");
+            t3 = strtok(NULL, "\t, \r\n");
+            if (t1 == NULL || t2 == NULL ) continue;
+            if( atoi(t1) == atoi(t2) ) continue;
+            weight[nbuf++] = t3 != NULL ? atof(t3) : 1;
+            if( nbuf == EDGE_SIZE ){
+                pwritea(weightf, weight, nbuf*sizeof(float), nedges*sizeof(float));
+                nedges += nbuf;
+                nbuf = 0;
+            }
+        }
+        pwritea(weightf, weight, nbuf*sizeof(float), nedges*sizeof(float));
+        nedges += nbuf;
+        fclose(inf);
+        close(weightf);
+        free(weight);
+        logstream(LOG_INFO) << "Edge weights : " << nedges << " edges" << std::endl;
+    }
+
+    /**
+     * Write file_0.alias, the alias table of every vertex over its out edges
+     * by file_0.weight, parallel to the csr like the weights. It does not
+     * depend on the blocksize and is only written once.
+     */
+    void compute_alias(std::string filename){
+        std::string fidfile = fidname(filename, 0);
+        int beg_posf = open((fidfile + ".beg_pos").c_str(), O_RDONLY);
+        int weightf = open((fidfile + ".weight").c_str(), O_RDONLY);
+        int aliasf = open((fidfile + ".alias").c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+        if (beg_posf < 0 || weightf < 0 || aliasf < 0) {
+            logstream(LOG_FATAL) << "Could not build the alias tables of :" << fidfile << ", error: " << strerror(errno) << std::endl;
+        }
+        assert(beg_posf > 0 && weightf > 0 && aliasf > 0);
+        vid_t nverts = lseek(beg_posf, 0, SEEK_END) / sizeof(eid_t) - 1;
+        eid_t nedges;
+        preada(beg_posf, &nedges, sizeof(eid_t), (size_t)nverts*sizeof(eid_t));
+        if ((eid_t)lseek(weightf, 0, SEEK_END) != nedges*sizeof(float)) {
+            logstream(LOG_FATAL) << "The edge weights of " << filename << " do not match its " << nedges << " edges, remove " << filename << "_GraphWalker/ to convert it again." << std::endl;
+            assert(false);
+        }
+
+        std::vector<float> weight;
+        std::vector<alias_entry> tab;
+        eid_t *beg_pos = (eid_t*) malloc(VERT_SIZE*sizeof(eid_t));
+        vid_t nread = 0;
+        while(nread < nverts){
+            vid_t rv = nverts - nread + 1 < VERT_SIZE ? nverts - nread + 1 : VERT_SIZE; //overlap a vertex to get the last out degree
+            preada(beg_posf, beg_pos, (size_t)rv*sizeof(eid_t), (size_t)nread*sizeof(eid_t));
+            /* vertices of the chunk in runs of at most EDGE_SIZE edges, a vertex of more on its own */
+            for(vid_t v = 0; v + 1 < rv; ){
+                vid_t u = v + 1;
+                while(u + 1 < rv && beg_pos[u+1] - beg_pos[v] <= EDGE_SIZE) u++;
+                eid_t ne = beg_pos[u] - beg_pos[v];
+                weight.resize(ne + 1);
+                tab.resize(ne + 1);
+                preada(weightf, &weight[0], ne*sizeof(float), beg_pos[v]*sizeof(float));
+                for(vid_t x = v; x < u; x++)
+                    build_alias(&weight[beg_pos[x] - beg_pos[v]], beg_pos[x+1] - beg_pos[x], &tab[beg_pos[x] - beg_pos[v]]);
+                pwritea(aliasf, &tab[0], ne*sizeof(alias_entry), beg_pos[v]*sizeof(alias_entry));
+                v = u;
+            }
+            nread += rv - 1;
+        }
+        free(beg_pos);
+        close(beg_posf);
+        close(weightf);
+        close(aliasf);
+        logstream(LOG_INFO) << "Alias tables : " << nverts << " vertices, " << nedges << " edges" << std::endl;
+    }
+
     /**
      * Converts graph from an edge list format. Input may contain
      * value for the edges. Self-edges are ignored.
@@ -400,6 +679,26 @@
             logstream(LOG_INFO) << "Successfully finished compute_block for " << basefilename << std::endl;
             logstream(LOG_INFO) << "computed " << nblocks << " blocks." << std::endl;
         }
+
+        if(get_option_int("compressed", 0) && access(vcsrindexname(basefilename, blocksize_kb).c_str(), F_OK) != 0){
+            logstream(LOG_INFO) << "Will try compress the csr now..." << std::endl;
+            compress_csr(basefilename, blocksize_kb);
+        }
+        unsigned bloom_bits = get_option_int("bloom_bits", 0);
+        if(bloom_bits > 0 && access(neighborbloomname(basefilename, blocksize_kb, bloom_bits).c_str(), F_OK) != 0){
+            logstream(LOG_INFO) << "Will try build the neighbor Bloom filters now..." << std::endl;
+            compute_neighbor_bloom(basefilename, blocksize_kb, bloom_bits);
+        }
+        if(get_option_int("weighted", 0) && access((fidname(basefilename, 0) + ".alias").c_str(), F_OK) != 0){
+            logstream(LOG_INFO) << "Will try build the alias tables of the edge weights now..." << std::endl;
+            if(access((fidname(basefilename, 0) + ".weight").c_str(), F_OK) != 0) write_edge_weights(basefilename);
+            compute_alias(basefilename);
+        }
+        unsigned long long hotcache_kb = get_option_long("hotcache_kb", 0);
+        if(hotcache_kb > 0 && access(hotverticesname(basefilename, hotcache_kb).c_str(), F_OK) != 0){
+            logstream(LOG_INFO) << "Will try rank the hot vertices now..." << std::endl;
+            compute_hotvertices(basefilename, hotcache_kb);
+        }
         return nblocks;
     }
 
@@ -0,0 +1,69 @@
+#ifndef DEF_GRAPHWALKER_HUGEPAGE
+#define DEF_GRAPHWALKER_HUGEPAGE
+
+#include <string>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include "logger/logger.hpp"
+
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+/* what backs the large engine and walk buffers, option hugepages */
+enum hugepage_t { HUGEPAGE_NONE, HUGEPAGE_THP, HUGEPAGE_HUGETLB };
+
+static hugepage_t parse_hugepages(std::string name) {
+    if (name == "thp") return HUGEPAGE_THP;
+    if (name == "hugetlb") return HUGEPAGE_HUGETLB;
+    if (name != "none") {
+        logstream(LOG_WARNING) << "Unknown hugepages " << name << ", use none." << std::endl;
+    }
+    return HUGEPAGE_NONE;
+}
+
+static const char *hugepages_name(hugepage_t mode) {
+    return mode == HUGEPAGE_HUGETLB ? "hugetlb" : mode == HUGEPAGE_THP ? "thp" : "none";
+}
+
+/**
+ * Map nbytes of anonymous memory on 2MB pages: from the hugetlbfs pool with
+ * HUGEPAGE_HUGETLB, else a huge page aligned region advised MADV_HUGEPAGE.
+ * hugetlb falls back to THP, and THP to normal pages, when the system has
+ * none to give. The mapped length is returned in *mapped for hugepage_free.
+ */
+static void *hugepage_alloc(size_t nbytes, hugepage_t mode, size_t *mapped) {
+    static bool warned_hugetlb = false, warned_thp = false;
+    size_t len = (nbytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    if (len == 0) len = HUGE_PAGE_SIZE;
+    *mapped = len;
+    if (mode == HUGEPAGE_HUGETLB) {
+        void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+        if (p != MAP_FAILED) return p;
+        if (!warned_hugetlb) {
+            logstream(LOG_WARNING) << "Could not map hugetlbfs pages: " << strerror(errno) << ", use transparent huge pages." << std::endl;
+            warned_hugetlb = true;
+        }
+    }
+    /* over-map by a huge page and trim, so the region starts on a huge page */
+    char *raw = (char*)mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        logstream(LOG_FATAL) << "Could not map " << len << " bytes: " << strerror(errno) << std::endl;
+        assert(false);
+    }
+    char *p = (char*)(((size_t)raw + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+    if (p > raw) munmap(raw, p - raw);
+    munmap(p + len, raw + HUGE_PAGE_SIZE - p);
+    if (madvise(p, len, MADV_HUGEPAGE) != 0 && !warned_thp) {
+        logstream(LOG_WARNING) << "Transparent huge pages are not available: " << strerror(errno) << std::endl;
+        warned_thp = true;
+    }
+    return p;
+}
+
+static void hugepage_free(void *p, size_t mapped) {
+    munmap(p, mapped);
+}
+
+#endif
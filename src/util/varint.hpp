@@ -0,0 +1,68 @@
+#ifndef DEF_GRAPHWALKER_VARINT
+#define DEF_GRAPHWALKER_VARINT
+
+#include <stdint.h>
+#include "api/datatype.hpp"
+
+/**
+ * LEB128 varints, 7 bits per byte with the high bit set on all but the last.
+ */
+static inline unsigned varint_encode(uint64_t v, unsigned char *out) {
+    unsigned n = 0;
+    while (v >= 0x80) {
+        out[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (unsigned char)v;
+    return n;
+}
+
+static inline uint64_t varint_decode(const unsigned char * &in) {
+    uint64_t v = *in & 0x7f;
+    unsigned shift = 7;
+    while (*in++ & 0x80) {
+        v |= (uint64_t)(*in & 0x7f) << shift;
+        shift += 7;
+    }
+    return v;
+}
+
+static inline uint64_t zigzag_encode(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/**
+ * Max bytes the adjacency list of a vertex with outd neighbors encodes to.
+ */
+static inline size_t adjacency_bound(eid_t outd) {
+    return outd * 5;
+}
+
+/**
+ * Encode the neighbors of v as zigzag varint deltas, the first one against
+ * v itself. Neighbor order is kept, so it decodes back to the .csr exactly;
+ * sorted lists compress best. Returns the number of bytes written.
+ */
+static inline size_t encode_adjacency(vid_t v, const vid_t *nbrs, eid_t outd, unsigned char *out) {
+    size_t n = 0;
+    int64_t prev = v;
+    for (eid_t i = 0; i < outd; i++) {
+        n += varint_encode(zigzag_encode((int64_t)nbrs[i] - prev), out + n);
+        prev = nbrs[i];
+    }
+    return n;
+}
+
+static inline void decode_adjacency(vid_t v, const unsigned char * &in, eid_t outd, vid_t *nbrs) {
+    int64_t prev = v;
+    for (eid_t i = 0; i < outd; i++) {
+        prev += zigzag_decode(varint_decode(in));
+        nbrs[i] = (vid_t)prev;
+    }
+}
+
+#endif
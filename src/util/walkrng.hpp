@@ -0,0 +1,110 @@
+#ifndef DEF_GRAPHWALKER_WALKRNG
+#define DEF_GRAPHWALKER_WALKRNG
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * xoshiro256** stream for the walk kernels, one per thread and a cache line
+ * each. seed() expands a seed with splitmix64 and jumps the stream number of
+ * times 2^128 ahead, so the streams of the threads never overlap. bounded()
+ * draws from [0, n) by Lemire's multiply and shift, rejecting only when the
+ * low half falls short, instead of a modulo; chance() compares against a
+ * threshold precomputed by threshold(), so a hop costs no division.
+ */
+class walk_rng {
+    uint64_t s[4];
+    char pad[64 - 4 * sizeof(uint64_t)];
+
+    static inline uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    static inline uint64_t splitmix64(uint64_t &z) {
+        uint64_t x = (z += 0x9e3779b97f4a7c15ULL);
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    /* 2^128 draws ahead */
+    void jump() {
+        static const uint64_t JUMP[4] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+        uint64_t t[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < 4; i++) {
+            for (int b = 0; b < 64; b++) {
+                if (JUMP[i] & (1ULL << b)) {
+                    t[0] ^= s[0];
+                    t[1] ^= s[1];
+                    t[2] ^= s[2];
+                    t[3] ^= s[3];
+                }
+                next();
+            }
+        }
+        s[0] = t[0];
+        s[1] = t[1];
+        s[2] = t[2];
+        s[3] = t[3];
+    }
+
+    /* [0, n) from 32 random bits r */
+    static inline bool fit(uint32_t r, uint32_t n, uint32_t &v) {
+        uint64_t m = (uint64_t)r * n;
+        if ((uint32_t)m < n && (uint32_t)m < (uint32_t)(-n) % n) return false;
+        v = (uint32_t)(m >> 32);
+        return true;
+    }
+
+public:
+    walk_rng() {
+        seed(0, 0);
+    }
+
+    void seed(uint64_t seed, unsigned stream) {
+        for (int i = 0; i < 4; i++) s[i] = splitmix64(seed);
+        for (unsigned i = 0; i < stream; i++) jump();
+    }
+
+    inline uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    /* uniform in [0, n), n > 0 */
+    inline uint32_t bounded(uint32_t n) {
+        uint32_t v;
+        while (!fit((uint32_t)(next() >> 32), n, v));
+        return v;
+    }
+
+    /* k draws from [0, n), two out of every 64 random bits */
+    void bounded(uint32_t n, uint32_t *out, size_t k) {
+        size_t i = 0;
+        while (i < k) {
+            uint64_t r = next();
+            if (fit((uint32_t)(r >> 32), n, out[i])) i++;
+            if (i < k && fit((uint32_t)r, n, out[i])) i++;
+        }
+    }
+
+    /* the threshold for chance() to be true with probability p */
+    static uint64_t threshold(double p) {
+        if (p <= 0) return 0;
+        if (p >= 1) return 1ULL << 32;
+        return (uint64_t)(p * 4294967296.0);
+    }
+
+    inline bool chance(uint64_t threshold) {
+        return (next() >> 32) < threshold;
+    }
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef DEF_BLOCK_HEAP
+#define DEF_BLOCK_HEAP
+
+#include <vector>
+#include <queue>
+#include <functional>
+#include "api/datatype.hpp"
+
+/**
+ * Indexed binary heap over all blocks, the best key on top, where Better
+ * is std::greater for a max heap and std::less for a min heap. pos keeps
+ * where each block sits, so the key of any block can be changed in
+ * O(log nblocks) and the best block read in O(1).
+ */
+template <typename K, typename Better>
+class block_heap {
+	std::vector<bid_t> heap;
+	std::vector<size_t> pos; //of each block in heap
+	std::vector<K> key; //of each block
+	Better better;
+
+	void place(size_t i, bid_t b){
+		heap[i] = b;
+		pos[b] = i;
+	}
+
+	/* orders heap positions for best(), the best key on top */
+	struct worse {
+		block_heap *h;
+		worse(block_heap *_h) : h(_h) {}
+		bool operator()(size_t i, size_t j) const {
+			return h->better(h->key[h->heap[j]], h->key[h->heap[i]]);
+		}
+	};
+
+	void siftUp(size_t i){
+		bid_t b = heap[i];
+		while(i > 0 && better(key[b], key[heap[(i-1)/2]])){
+			place(i, heap[(i-1)/2]);
+			i = (i-1)/2;
+		}
+		place(i, b);
+	}
+
+	void siftDown(size_t i){
+		bid_t b = heap[i];
+		size_t n = heap.size();
+		while(true){
+			size_t c = 2*i + 1;
+			if(c >= n) break;
+			if(c + 1 < n && better(key[heap[c+1]], key[heap[c]])) c++;
+			if(!better(key[heap[c]], key[b])) break;
+			place(i, heap[c]);
+			i = c;
+		}
+		place(i, b);
+	}
+
+public:
+	/* all blocks with the given keys */
+	void build(bid_t nblocks, const K *keys){
+		heap.resize(nblocks);
+		pos.resize(nblocks);
+		key.assign(keys, keys + nblocks);
+		for(bid_t b = 0; b < nblocks; b++) place(b, b);
+		for(size_t i = nblocks/2; i-- > 0; ) siftDown(i);
+	}
+
+	void update(bid_t b, K k){
+		if(k == key[b]) return;
+		bool up = better(k, key[b]);
+		key[b] = k;
+		if(up) siftUp(pos[b]);
+		else siftDown(pos[b]);
+	}
+
+	bid_t top(){
+		return heap[0];
+	}
+
+	K keyOf(bid_t b){
+		return key[b];
+	}
+
+	/* up to k best blocks other than skip, best first, in O(k log k) */
+	bid_t best(bid_t k, bid_t skip, bid_t *out){
+		std::priority_queue<size_t, std::vector<size_t>, worse> cand(worse(this));
+		bid_t n = 0;
+		if(!heap.empty()) cand.push(0);
+		while(n < k && !cand.empty()){
+			size_t i = cand.top();
+			cand.pop();
+			if(heap[i] != skip) out[n++] = heap[i];
+			if(2*i + 1 < heap.size()) cand.push(2*i + 1);
+			if(2*i + 2 < heap.size()) cand.push(2*i + 2);
+		}
+		return n;
+	}
+};
+
+#endif
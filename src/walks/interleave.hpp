@@ -0,0 +1,102 @@
+#ifndef DEF_WALK_INTERLEAVE
+#define DEF_WALK_INTERLEAVE
+
+#include <omp.h>
+
+#include "api/datatype.hpp"
+#include "walks/walk.hpp"
+
+#define INTERLEAVE_MAX 32 // most walks a thread steps in lock-step
+
+/**
+ * Step the n walks of a batch interleaved, up to width of them at a time,
+ * for the first order kernels. A step is split at its dependent loads: the
+ * beg_pos of the walk's vertex, then the edge it draws (and its alias entry)
+ * in the csr. Every live walk issues its prefetch for one before any walk
+ * consumes it, so the misses of the batch overlap instead of each walk
+ * waiting on its own. Kernel supplies the stop condition:
+ *  live(hop)                    another step may be taken at hop
+ *  offEdges(dstId, sourId, rnd) the walk takes no edge, false if it ends,
+ *                               else dstId is where it goes
+ * A walk leaving the block is moved on as in updateByWalk.
+ */
+template <class Kernel>
+void interleaveWalks(Kernel &k, WalkDataType *walks, wid_t n, bid_t exec_block, eid_t *beg_pos, vid_t *csr, WalkManager &walk_manager, unsigned width){
+    struct lane {
+        WalkDataType walk;
+        vid_t sourId, dstId;
+        hid_t hop;
+        vid_t *adj;
+        alias_entry *tab;
+        vid_t pick; //edge drawn, NO_PREV if none
+    };
+    lane lanes[INTERLEAVE_MAX];
+    if(width > INTERLEAVE_MAX) width = INTERLEAVE_MAX;
+    if(width == 0) width = 1;
+    tid_t threadid = omp_get_thread_num();
+    walk_rng &rnd = k.rng[threadid];
+    vid_t st = k.blocks[exec_block], en = k.blocks[exec_block+1];
+    wid_t next = 0;
+    unsigned nlanes = 0;
+    while(true){
+        while(nlanes < width && next < n){
+            lane &l = lanes[nlanes++];
+            l.walk = walks[next++];
+            l.sourId = walk_manager.getSourceId(l.walk);
+            l.dstId = walk_manager.getCurrentId(l.walk) + st;
+            l.hop = walk_manager.getHop(l.walk);
+        }
+        if(nlanes == 0) break;
+
+        /* the beg_pos of every walk's vertex */
+        for(unsigned i = 0; i < nlanes; i++){
+            vid_t v = lanes[i].dstId;
+            if(v >= st && v < en) __builtin_prefetch(beg_pos + (v - st));
+        }
+
+        /* visit, draw an edge and prefetch it, or leave the block */
+        for(unsigned i = 0; i < nlanes; ){
+            lane &l = lanes[i];
+            eid_t outd;
+            if(!k.live(l.hop)){
+                l = lanes[--nlanes];
+                continue;
+            }
+            if(!k.adjacency(l.dstId, exec_block, beg_pos, csr, l.adj, outd, l.tab)){
+                bid_t p = k.getblock(l.dstId);
+                if(p < k.nblocks){
+                    walk_manager.moveWalk(l.walk, p, threadid, l.dstId - k.blocks[p]);
+                    walk_manager.setMinStep(p, l.hop);
+                }
+                l = lanes[--nlanes];
+                continue;
+            }
+            k.updateInfo(l.sourId, l.dstId, threadid, l.hop);
+            if(outd > 0 && !rnd.chance(k.restart)){
+                l.pick = rnd.bounded(outd);
+                __builtin_prefetch(l.adj + l.pick);
+                if(l.tab != NULL) __builtin_prefetch(l.tab + l.pick);
+            }else if(k.offEdges(l.dstId, l.sourId, rnd)){
+                l.pick = NO_PREV;
+            }else{
+                l = lanes[--nlanes];
+                continue;
+            }
+            i++;
+        }
+
+        /* take the edges */
+        for(unsigned i = 0; i < nlanes; i++){
+            lane &l = lanes[i];
+            if(l.pick != NO_PREV){
+                vid_t e = l.pick;
+                if(l.tab != NULL && !rnd.chance(l.tab[e].prob)) e = l.tab[e].alias;
+                l.dstId = l.adj[e];
+            }
+            l.hop++;
+            walk_manager.nextHop(l.walk);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef NODE2VECWALK
+#define NODE2VECWALK
+
+#include <string>
+#include <algorithm>
+
+#include "walks/walk.hpp"
+#include "walks/randomwalk.hpp"
+#include "api/datatype.hpp"
+#include "api/nbrbloom.hpp"
+
+/**
+ * Second order walks of node2vec. Leaving v for x after coming from t, the
+ * edge (v, x) weighs 1/p if x is t, 1 if x is an out neighbour of t and 1/q
+ * otherwise, times its own weight with option weighted. The step is drawn by
+ * rejection: an edge of v as in a first order walk, kept with chance of its
+ * factor over the largest, so there are no per edge transition tables. The
+ * edges of t are searched where t is in the executing block or the hot
+ * vertex store, else its block's neighbor Bloom filter answers, so those
+ * must be loaded once walks cross blocks. Needs the WALK_RECORD=160
+ * layout, which keeps t in the walk.
+ */
+class Node2vecWalk : public RandomWalk {
+
+public:
+    vid_t N;
+    float p, q;
+    uint64_t retthr, inthr, outthr; //chance thresholds of the three factors over the largest
+    uint64_t minthr, maxthr;
+
+public:
+
+    void initializeRW(vid_t _N, wid_t _R, hid_t _L, float _p, float _q){
+        N = _N;
+        R = _R;
+        L = _L;
+        p = _p;
+        q = _q;
+        if(p <= 0 || q <= 0){
+            logstream(LOG_FATAL) << "node2vec needs p > 0 and q > 0, got p = " << p << ", q = " << q << std::endl;
+            assert(false);
+        }
+        if(!walk_layout::has_prev){
+            logstream(LOG_FATAL) << "node2vec walks keep the previous vertex, rebuild with -DWALK_RECORD=160." << std::endl;
+            assert(false);
+        }
+        double big = std::max(1.0/p, std::max(1.0, 1.0/q));
+        retthr = walk_rng::threshold(1.0/p/big);
+        inthr = walk_rng::threshold(1.0/big);
+        outthr = walk_rng::threshold(1.0/q/big);
+        minthr = std::min(inthr, outthr);
+        maxthr = std::max(inthr, outthr);
+    }
+
+    /* a step of walk walkId, from source s, reaches dstId */
+    virtual void updateStep(uint32_t walkId, vid_t s, vid_t dstId, tid_t threadid, hid_t hop){
+        updateInfo(s, dstId, threadid, hop);
+    }
+
+    /* x is an out neighbour of t, or may be if only the Bloom filter knows */
+    bool isNeighbor(vid_t t, vid_t x, bid_t exec_block, eid_t *beg_pos, vid_t *csr){
+        vid_t *adj;
+        eid_t outd;
+        alias_entry *tab;
+        if(adjacency(t, exec_block, beg_pos, csr, adj, outd, tab))
+            return std::find(adj, adj + outd, x) != adj + outd;
+        if(bloom == NULL){
+            logstream(LOG_FATAL) << "node2vec walks crossing blocks need the neighbor Bloom filters, none are loaded (option bloom_bits)." << std::endl;
+            assert(false);
+        }
+        return bloom->mayContain(blockOf(t), t, x);
+    }
+
+    /* next vertex after dstId with the outd > 0 edges adj, coming from prev */
+    vid_t pickSecondOrder(vid_t prev, vid_t *adj, eid_t outd, alias_entry *tab, walk_rng &rnd, bid_t exec_block, eid_t *beg_pos, vid_t *csr){
+        while(true){
+            vid_t x = pickEdge(adj, outd, tab, rnd);
+            if(prev == NO_PREV) return x;
+            uint64_t r = rnd.next() >> 32;
+            if(x == prev){
+                if(r < retthr) return x;
+            }else if(r < minthr){
+                return x;
+            }else if(r < maxthr){
+                bool in = isNeighbor(prev, x, exec_block, beg_pos, csr);
+                if(r < (in ? inthr : outthr)) return x;
+            }
+        }
+    }
+
+    void updateByWalk(WalkDataType walk, wid_t walkid, bid_t exec_block, eid_t *&beg_pos, vid_t *&csr, WalkManager &walk_manager ){
+        tid_t threadid = omp_get_thread_num();
+        walk_rng &rnd = rng[threadid];
+        WalkDataType nowWalk = walk;
+        vid_t sourId = walk_manager.getSourceId(nowWalk);
+        vid_t dstId = walk_manager.getCurrentId(nowWalk) + blocks[exec_block];
+        vid_t prev = walk_manager.getPrevId(nowWalk);
+        hid_t hop = walk_manager.getHop(nowWalk);
+        vid_t *adj;
+        eid_t outd;
+        alias_entry *tab;
+        while (hop < L && adjacency(dstId, exec_block, beg_pos, csr, adj, outd, tab)){
+            updateStep(walk_manager.getWalkId(nowWalk), sourId, dstId, threadid, hop);
+            if (outd == 0) return; //a dead end stops the walk
+            vid_t next = pickSecondOrder(prev, adj, outd, tab, rnd, exec_block, beg_pos, csr);
+            prev = dstId;
+            dstId = next;
+            hop++;
+            walk_manager.nextHop(nowWalk);
+        }
+        if( hop < L ){
+            bid_t b = blockOf( dstId );
+            if(b>=nblocks) return;
+            walk_manager.moveWalk(walk_manager.stepFrom(nowWalk, prev), b, threadid, dstId - blocks[b]);
+            walk_manager.setMinStep( b, hop );
+        }
+    }
+
+    /* block of v by binary search, nblocks if v is past the last one */
+    bid_t blockOf(vid_t v){
+        return std::upper_bound(blocks, blocks + nblocks + 1, v) - blocks - 1;
+    }
+
+};
+
+#endif
@@ -4,9 +4,14 @@
 #include <string>
 #include <fstream>
 #include <time.h>
+#include <vector>
 
 #include "walks/walk.hpp" 
 #include "api/datatype.hpp"
+#include "api/hotvertices.hpp"
+#include "api/edgealias.hpp"
+#include "api/nbrbloom.hpp"
+#include "util/walkrng.hpp"
 
 /**
  * Type definitions. Remember to create suitable graph shards using the
@@ -20,9 +25,36 @@ public:
     vid_t *blocks;
     wid_t R;
     hid_t L;
+    hot_vertices *hot; //set by the engine with option hotcache_kb
+    alias_entry *alias; //edge alias tables of the executing block, set by the engine with option weighted
+    neighbor_bloom *bloom; //set by the engine with option bloom_bits
+    std::vector< std::pair<void*, size_t> > state; //of the app, saved with checkpoints
+    walk_rng *rng; //stream of each thread, set up by the engine
+    unsigned interleave; //walks stepped in lock-step by updateByWalks, set by the engine with option interleave
+    uint64_t restart; //threshold of the 0.15 chance that a walk leaves its edges, to restart, stop or jump
 
 public:
 
+    RandomWalk() : hot(NULL), alias(NULL), bloom(NULL), rng(NULL), interleave(0) {
+        restart = walk_rng::threshold(0.15);
+    }
+
+    virtual ~RandomWalk() {
+        if(rng != NULL) delete [] rng;
+    }
+
+    void initRng(tid_t nthreads, uint64_t seed){
+        if(rng != NULL) delete [] rng;
+        rng = new walk_rng[nthreads];
+        for(tid_t t = 0; t < nthreads; t++)
+            rng[t].seed(seed, t);
+    }
+
+    /* memory the app updates as walks go, to be saved with checkpoints; register it in initializeApp */
+    void registerState(void *p, size_t nbytes){
+        state.push_back(std::make_pair(p, nbytes));
+    }
+
     //for SimRank
     virtual void startWalksbyApp( WalkManager &walk_manager){
         logstream(LOG_ERROR) << "No definition of function : startWalksbyApp!" << std::endl;
@@ -33,6 +65,30 @@ public:
         logstream(LOG_ERROR) << "No definition of function : updateInfo!" << std::endl;
     }
 
+    /**
+     * Out edges of dstId, from the executing block or from the hot vertex
+     * store, and their alias table if the walks go by edge weight. Returns
+     * false if it is in neither, then the walk has to move.
+     */
+    bool adjacency(vid_t dstId, bid_t exec_block, eid_t *beg_pos, vid_t *csr, vid_t *&adj, eid_t &outd, alias_entry *&tab){
+        if(dstId >= blocks[exec_block] && dstId < blocks[exec_block+1]){
+            vid_t dstIdp = dstId - blocks[exec_block];
+            outd = beg_pos[dstIdp+1] - beg_pos[dstIdp];
+            adj = csr + (beg_pos[dstIdp] - beg_pos[0]);
+            tab = alias != NULL ? alias + (beg_pos[dstIdp] - beg_pos[0]) : NULL;
+            return true;
+        }
+        tab = NULL;
+        return hot != NULL && hot->find(dstId, adj, outd);
+    }
+
+    /* out neighbour to step to, uniform or by the alias table tab, outd > 0 */
+    inline vid_t pickEdge(vid_t *adj, eid_t outd, alias_entry *tab, walk_rng &rnd){
+        vid_t i = rnd.bounded(outd);
+        if(tab != NULL && !rnd.chance(tab[i].prob)) i = tab[i].alias;
+        return adj[i];
+    }
+
     /**
      *  Walk update function.
      */
@@ -40,6 +96,15 @@ public:
         logstream(LOG_ERROR) << "No definition of function : updateByWalk!" << std::endl;
     }
     
+    /**
+     * Update the n walks of a batch, which are curwalks from first on. The
+     * first order kernels step them interleaved with option interleave.
+     */
+    virtual void updateByWalks(WalkDataType *walks, wid_t n, wid_t first, bid_t exec_block, eid_t *beg_pos, vid_t *csr, WalkManager &walk_manager){
+        for(wid_t i = 0; i < n; i++)
+            updateByWalk(walks[i], first + i, exec_block, beg_pos, csr, walk_manager);
+    }
+
     /**
      * Called before an execution block is started.
      */
@@ -8,11 +8,47 @@
 #include <unistd.h>
 #include <string>
 #include <queue>
+#include <deque>
+#include <pthread.h>
+#include <vector>
+#include <algorithm>
 
 #include "metrics/metrics.hpp"
 #include "api/filename.hpp"
 #include "api/io.hpp"
+#include "api/iobackend.hpp"
 #include "walks/walkbuffer.hpp"
+#include "walks/walkspill.hpp"
+#include "walks/blockheap.hpp"
+#include "walks/walkcheckpoint.hpp"
+#include "util/hugepage.hpp"
+#include "util/varint.hpp"
+
+#define WALK_OPEN_CHUNKS 16 // most open chunks of a thread, by block modulo their number
+
+/* chunk of a block a thread appends to */
+struct open_chunk {
+	bid_t block;
+	walk_chunk *c; //NULL if none
+};
+
+/* walks a thread stages, a cache line apart from the other threads' */
+struct touched_blocks {
+	std::vector<bid_t> blocks; //moved walks to since the last updateWalkNum
+	open_chunk open[WALK_OPEN_CHUNKS];
+	char pad[64 - (sizeof(std::vector<bid_t>) + WALK_OPEN_CHUNKS*sizeof(open_chunk)) % 64];
+};
+
+/* a checkpoint on its way to disk: what the main thread took between two blocks, and where the spill writer put the walks */
+struct walk_checkpoint_job {
+	walk_checkpoint_header hdr;
+	std::vector<wid_t> walknum, dwalknum;
+	std::vector<hid_t> minstep;
+	std::vector< std::vector<char> > state; //copy of the app state
+	std::vector<uint64_t> nexts;
+	std::vector<walk_checkpoint_extent> exts;
+	bool ready; //the spill writer filled in the extents
+};
 
 class WalkManager
 {
@@ -25,108 +61,590 @@ public:
 	wid_t* walknum; //number of tptal walks of each block
 	wid_t* dwalknum; //number of disk walks of each block
 	hid_t* minstep;
-	WalkBuffer **pwalks;
+	WalkBuffer *pwalks; //chunks of each block handed in by the threads
+	walk_chunk_pool *chunks;
+	unsigned nopen; //open chunks of each thread
+	std::vector<bid_t> spillable; //blocks whose list may hold chunks, for spillFullest
+	bool *inspillable;
+	size_t spillcur; //where the search for a block to spill resumes
+	mutex spillable_lock;
+	walk_spill_store *spill; //walks spilled out of the walk buffers
+	io_backend *wio; //walk pool reads of the main thread
+
+	/* Spill writer, writes the chunks handed over by moveWalk in the background */
+	std::deque< std::pair<bid_t, walk_chunk*> > spill_queue; //(block, its chunks), no chunks marks a checkpoint
+	bool spill_stop, spill_busy;
+	mutex spill_lock;
+	conditional spill_cond;
+	pthread_t spill_thread;
+	io_backend *spill_io;
+	bool compresswalks; //spill in the packed walk format
+	unsigned char *packbuf; //of the spill writer
+	unsigned char *unpackbuf; //packed walks read back by the main thread
+	size_t unpackbuf_sz;
 
 	bid_t curp; //current block id
-	WalkDataType *curwalks; // all walks of current block
+	WalkDataType *curwalks; // all walks of current block, in walkarena, sortbuf or curchunk
+	WalkDataType *walkarena; //reused for the walks of every block
+	wid_t walkarena_sz;
+	walk_chunk *curchunk; //the only chunk of the current block, run in place
+	std::vector<walk_chunk*> gatherchunks; //chunks of the current block and where they go in curwalks
+	std::vector<wid_t> gatheroffs;
+	WalkDataType *sortbuf; //the other side of the counting sort of curwalks
+	wid_t sortbuf_sz;
+	std::vector<wid_t> sortcnt; //bucket counts of each thread
 	wid_t walksum;
 
-	bool* ismodified;
+	bool* ismodified; //in the touched list of some thread
+	touched_blocks *touched; //of each thread
+	std::vector<bid_t> recounted; //blocks whose walknum or minstep the last updateWalkNum changed
+
+	/* Blocks ranked for chooseBlock, rekeyed as their walknum and minstep change */
+	block_heap<wid_t, std::greater<wid_t> > walkheap;
+	block_heap<hid_t, std::less<hid_t> > stepheap; //only blocks holding walks count
+	block_heap<float, std::greater<float> > weightheap;
+
+	/* Checkpoint, for options checkpoint_sec and resume */
+	bool resumed; //the walks are those of the last checkpoint, not started by the app
+	walk_checkpoint_header ckpt; //resumed from
+	size_t ckpt_state_off; //of the app state in the checkpoint
+	walk_checkpoint_job *ckpt_job; //being written by ckpt_thread, NULL if none
+	pthread_t ckpt_thread;
+	bool ckpt_done; //ckpt_thread is through with ckpt_job
 
 public:
 	WalkManager(metrics &_m,bid_t _nblocks, tid_t _nthreads, std::string _base_filename):base_filename(_base_filename), nblocks(_nblocks), nthreads(_nthreads), m(_m){
-		pwalks = new WalkBuffer*[nthreads];
-		for(tid_t i = 0; i < nthreads; i++)
-			pwalks[i] = new WalkBuffer[nblocks];
+		pwalks = new WalkBuffer[nblocks];
+		inspillable = (bool*)malloc(nblocks*sizeof(bool));
+		memset(inspillable, false, nblocks*sizeof(bool));
+		spillcur = 0;
 
 		walknum = (wid_t*)malloc(nblocks*sizeof(wid_t));
 		dwalknum = (wid_t*)malloc(nblocks*sizeof(wid_t));
 		minstep = (hid_t*)malloc(nblocks*sizeof(hid_t));
 		memset(walknum, 0, nblocks*sizeof(wid_t));
 		memset(dwalknum, 0, nblocks*sizeof(wid_t));
-		memset(minstep, 0xffff, nblocks*sizeof(hid_t));
+		memset(minstep, 0xff, nblocks*sizeof(hid_t)); //no walks, (hid_t)-1
 		walksum = 0;
 
-		rm_dir((base_filename+"_GraphWalker/walks/").c_str());
-		mkdir((base_filename+"_GraphWalker/walks/").c_str(), 0777);	
+		resumed = get_option_int("resume", 0) && openCheckpoint();
+		if(!resumed){
+			rm_dir((base_filename+"_GraphWalker/walks/").c_str());
+			mkdir((base_filename+"_GraphWalker/walks/").c_str(), 0777);
+		}
 
 		ismodified = (bool*)malloc(nblocks*sizeof(bool));
 		memset(ismodified, false, nblocks*sizeof(bool));
+		touched = new touched_blocks[nthreads];
+		for(tid_t t = 0; t < nthreads; t++)
+			for(unsigned i = 0; i < WALK_OPEN_CHUNKS; i++)
+				touched[t].open[i].c = NULL;
+
+		std::string iobackend = get_option_string("iobackend", "sync");
+		spill = new walk_spill_store(walkspillname(base_filename), nblocks, resumed);
+		std::vector<int> fds(1, spill->fd());
+		wio = create_io_backend(iobackend);
+		wio->register_files(fds);
+		spill_io = create_io_backend(iobackend);
+		spill_io->register_files(fds);
+
+		/* on huge pages the budget is only reserved, chunks take memory once walks are moved to them */
+		hugepage_t huge = parse_hugepages(get_option_string("hugepages", "none"));
+		size_t walkbuffer_mb = get_option_long("walkbuffer_mb", 1024);
+		size_t spillqueue = get_option_int("spillqueue", 2*nthreads); //chunks swapped in while others are written
+		/* the open chunks take at most half the budget, the threads keep fewer of them if it is small */
+		size_t budget = walkbuffer_mb*1024*1024;
+		int openchunks = get_option_int("openchunks", WALK_OPEN_CHUNKS);
+		nopen = openchunks < 1 ? 1 : (openchunks > WALK_OPEN_CHUNKS ? WALK_OPEN_CHUNKS : openchunks);
+		while(nopen > 1 && 2*nthreads*nopen*sizeof(walk_chunk) > budget) nopen /= 2;
+		if(2*nthreads*sizeof(walk_chunk) > budget){
+			budget = 2*nthreads*sizeof(walk_chunk);
+			logstream(LOG_WARNING) << "walkbuffer_mb is too small for " << nthreads << " threads, using " << budget/1024 << " KB." << std::endl;
+		}
+		chunks = new walk_chunk_pool(budget, spillqueue, nthreads, huge == HUGEPAGE_NONE ? HUGEPAGE_NONE : HUGEPAGE_THP);
+
+		compresswalks = get_option_int("compresswalks", 0);
+		packbuf = compresswalks ? (unsigned char*)malloc(WALK_SPILL_SLOT) : NULL;
+		unpackbuf = NULL;
+		unpackbuf_sz = 0;
+		curwalks = NULL;
+		walkarena = NULL;
+		walkarena_sz = 0;
+		curchunk = NULL;
+		sortbuf = NULL;
+		sortbuf_sz = 0;
+
+		spill_stop = false;
+		spill_busy = false;
+		ckpt_job = NULL;
+		int error = pthread_create(&spill_thread, NULL, spill_loop, this);
+		assert(!error);
+
+		if(resumed) loadCheckpoint();
+		indexBlocks();
 	}
 
 	~WalkManager(){
-		for(bid_t p = 0; p < nthreads; p++){
-			if(pwalks[p] != NULL){
-				delete [] pwalks[p];
-			}
-		}
+		finishCheckpoint();
+		spill_lock.lock();
+		spill_stop = true;
+		spill_cond.broadcast();
+		spill_lock.unlock();
+		pthread_join(spill_thread, NULL);
 		if(pwalks != NULL) delete [] pwalks;
+		free(inspillable);
+		delete [] touched;
+		free(ismodified);
+		delete chunks;
+		delete wio;
+		delete spill_io;
+		delete spill;
+		if(packbuf != NULL) free(packbuf);
+		if(unpackbuf != NULL) free(unpackbuf);
+		if(walkarena != NULL) free(walkarena);
+		if(sortbuf != NULL) free(sortbuf);
 		if(walknum != NULL) free(walknum);
 		if(dwalknum != NULL) free(dwalknum);
 		if(minstep != NULL) free(minstep);
 	}
 
-	WalkDataType encode( vid_t sourceId, vid_t currentId, hid_t hop ){
-		assert( hop < 16384 );
-		return (( (WalkDataType)sourceId & 0xffffff ) << 40 ) |(( (WalkDataType)currentId & 0x3ffffff ) << 14 ) | ( (WalkDataType)hop & 0x3fff ) ;
+	WalkDataType encode( vid_t sourceId, vid_t currentId, hid_t hop, uint32_t walkId = 0 ){
+		assert( hop <= walk_layout::max_hop );
+		return walk_layout::encode(sourceId, currentId, hop, walkId);
+	}
+
+	vid_t getSourceId( const WalkDataType &walk ){
+		return walk_layout::source(walk);
 	}
 
-	vid_t getSourceId( WalkDataType walk ){
-		return (vid_t)( walk >> 40 ) & 0xffffff;
+	vid_t getCurrentId( const WalkDataType &walk ){
+		return walk_layout::current(walk);
 	}
 
-	vid_t getCurrentId( WalkDataType walk ){
-		return (vid_t)( walk >> 14 ) & 0x3ffffff;
+	hid_t getHop( const WalkDataType &walk ){
+		return walk_layout::hop(walk);
 	}
 
-	hid_t getHop( WalkDataType walk ){
-		return (hid_t)(walk & 0x3fff) ;
+	/* id of the walk, with WALK_RECORD=128, else 0 */
+	uint32_t getWalkId( const WalkDataType &walk ){
+		return walk_layout::id(walk);
+	}
+
+	/* vertex the walk came from, with WALK_RECORD=160, else NO_PREV */
+	vid_t getPrevId( const WalkDataType &walk ){
+		return walk_layout::prev(walk);
+	}
+
+	/* the walk leaves prevId, before it is moved on to its next vertex */
+	WalkDataType stepFrom( WalkDataType walk, vid_t prevId ){
+		return walk_layout::step_from(walk, prevId);
+	}
+
+	void nextHop( WalkDataType &walk ){
+		walk_layout::next_hop(walk);
 	}
 
 	WalkDataType reencode( WalkDataType walk, vid_t toVertex ){
-		hid_t hop = getHop(walk);
-		vid_t source = getSourceId(walk);
-		walk = encode(source,toVertex,hop);
-		return walk;
+		return walk_layout::move(walk, toVertex);
+	}
+
+	struct by_current {
+		WalkManager *wm;
+		by_current(WalkManager *_wm) : wm(_wm) {}
+		bool operator()(const WalkDataType &a, const WalkDataType &b) const {
+			return wm->getCurrentId(a) < wm->getCurrentId(b);
+		}
+	};
+
+	static unsigned bitwidth(uint32_t v){
+		unsigned bits = 0;
+		while(bits < 32 && (v >> bits) > 0) bits++;
+		return bits;
+	}
+
+	static inline void putbits(unsigned char *out, size_t &nbytes, uint64_t &acc, unsigned &nacc, uint32_t v, unsigned bits){
+		acc |= (uint64_t)v << nacc;
+		nacc += bits;
+		while(nacc >= 8){
+			out[nbytes++] = (unsigned char)acc;
+			acc >>= 8;
+			nacc -= 8;
+		}
+	}
+
+	static inline uint32_t getbits(const unsigned char * &in, uint64_t &acc, unsigned &nacc, unsigned bits){
+		while(nacc < bits){
+			acc |= (uint64_t)*in++ << nacc;
+			nacc += 8;
+		}
+		uint32_t v = (uint32_t)(acc & ((1ULL << bits) - 1));
+		acc >>= bits;
+		nacc -= bits;
+		return v;
+	}
+
+	/**
+	 * Packed walk format: walks sorted by current vertex, whose deltas are
+	 * varints, followed by source, hop, walk id and, with WALK_RECORD=160,
+	 * previous vertex plus 1 bit packed at the widths the largest of them
+	 * needs. Sorts walks in place and returns the number of bytes written to
+	 * out, or 0 if that would not be smaller than raw.
+	 */
+	size_t packWalks(WalkDataType *walks, wid_t n, unsigned char *out){
+		std::sort(walks, walks + n, by_current(this));
+		uint32_t maxs = 0, maxh = 0, maxi = 0, maxp = 0;
+		for(wid_t i = 0; i < n; i++){
+			if(getSourceId(walks[i]) > maxs) maxs = getSourceId(walks[i]);
+			if(getHop(walks[i]) > maxh) maxh = getHop(walks[i]);
+			if(getWalkId(walks[i]) > maxi) maxi = getWalkId(walks[i]);
+			if(getPrevId(walks[i]) + 1 > maxp) maxp = getPrevId(walks[i]) + 1;
+		}
+		unsigned sbits = bitwidth(maxs), hbits = bitwidth(maxh), ibits = bitwidth(maxi), pbits = bitwidth(maxp);
+		size_t raw = n*sizeof(WalkDataType);
+		size_t nbytes = walk_layout::has_prev ? 4 : 3;
+		out[0] = sbits;
+		out[1] = hbits;
+		out[2] = ibits;
+		if(walk_layout::has_prev) out[3] = pbits;
+		vid_t prev = 0;
+		for(wid_t i = 0; i < n; i++){
+			if(nbytes + 5 > raw) return 0;
+			nbytes += varint_encode(getCurrentId(walks[i]) - prev, out + nbytes);
+			prev = getCurrentId(walks[i]);
+		}
+		if(nbytes + (n*(sbits + hbits + ibits + pbits) + 7)/8 >= raw) return 0;
+		uint64_t acc = 0;
+		unsigned nacc = 0;
+		for(wid_t i = 0; i < n; i++){
+			putbits(out, nbytes, acc, nacc, getSourceId(walks[i]), sbits);
+			putbits(out, nbytes, acc, nacc, getHop(walks[i]), hbits);
+			putbits(out, nbytes, acc, nacc, getWalkId(walks[i]), ibits);
+			putbits(out, nbytes, acc, nacc, getPrevId(walks[i]) + 1, pbits);
+		}
+		if(nacc > 0) out[nbytes++] = (unsigned char)acc;
+		return nbytes;
+	}
+
+	void unpackWalks(const unsigned char *in, wid_t n, WalkDataType *walks){
+		unsigned sbits = in[0], hbits = in[1], ibits = in[2], pbits = walk_layout::has_prev ? in[3] : 0;
+		const unsigned char *vin = in + (walk_layout::has_prev ? 4 : 3);
+		std::vector<vid_t> cur(n);
+		vid_t prev = 0;
+		for(wid_t i = 0; i < n; i++){
+			prev += (vid_t)varint_decode(vin);
+			cur[i] = prev;
+		}
+		uint64_t acc = 0;
+		unsigned nacc = 0;
+		for(wid_t i = 0; i < n; i++){
+			uint32_t source = getbits(vin, acc, nacc, sbits);
+			hid_t hop = getbits(vin, acc, nacc, hbits);
+			uint32_t id = getbits(vin, acc, nacc, ibits);
+			vid_t prevId = getbits(vin, acc, nacc, pbits) - 1;
+			walks[i] = stepFrom(walk_layout::encode(source, cur[i], hop, id), prevId);
+		}
 	}
 
+	/**
+	 * Stage a walk for block p. Thread t appends it to its open chunk in
+	 * slot p modulo nopen, no lock is taken; only a full chunk, or that of
+	 * another block the slot is taken from, goes to the block's list.
+	 */
 	void moveWalk( WalkDataType walk, bid_t p, tid_t t, vid_t toVertex ){
-		if(pwalks[t][p].size_w == WALK_BUFFER_SIZE){
-            // logstream(LOG_DEBUG) << "Walk buffer : pwalks["<< (int)t <<"]["<< p <<"] is ful with size_w = " << pwalks[t][p].size_w << " , WALK_BUFFER_SIZE = " << WALK_BUFFER_SIZE << std::endl;
-			writeWalks2Disk(t,p);
-        }
-        assert(pwalks[t][p].size_w < WALK_BUFFER_SIZE);
-		walk = reencode( walk, toVertex );
-		pwalks[t][p].push_back( walk );
-	}
-
-	void writeWalks2Disk(tid_t t, bid_t p){
-		m.start_time("4_writeWalks2Disk");
-		std::string walksfile = walksname( base_filename, p );
-		int f = open(walksfile.c_str(), O_WRONLY | O_CREAT | O_APPEND, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
-		pwritea( f, &pwalks[t][p][0], pwalks[t][p].size_w*sizeof(WalkDataType) );
-		dwalknum[p] += pwalks[t][p].size_w;
-		pwalks[t][p].size_w = 0;
-		close(f);
-		m.stop_time("4_writeWalks2Disk");
+		assert(t < nthreads);
+		touched_blocks &tb = touched[t];
+		open_chunk &o = tb.open[p % nopen];
+		if(o.c == NULL || o.block != p || o.c->size_w == WALK_BUFFER_SIZE)
+			openChunk(t, o, p);
+		o.c->walks[o.c->size_w++] = reencode( walk, toVertex );
+		if(!__atomic_load_n(&ismodified[p], __ATOMIC_RELAXED) && !__atomic_exchange_n(&ismodified[p], true, __ATOMIC_RELAXED))
+			tb.blocks.push_back(p);
+	}
+
+	/**
+	 * Make slot o of thread t an open chunk of block p with room. The chunk
+	 * it held goes to its block's list; if its walks could all be copied
+	 * into the partly filled chunk there, it is kept for p, else a chunk
+	 * comes from newChunk.
+	 */
+	void openChunk(tid_t t, open_chunk &o, bid_t p){
+		walk_chunk *c = o.c;
+		o.c = NULL;
+		if(c != NULL && c->size_w > 0) c = stageChunk(o.block, c);
+		if(c == NULL) c = newChunk(t, p);
+		o.block = p;
+		o.c = c;
+	}
+
+	/**
+	 * An empty chunk for thread t, which is moving walks to block p. When
+	 * the walk buffer budget runs low, the list of p, or of another block
+	 * if that is fuller, is handed to the spill writer first; the chunk
+	 * comes out of the headroom, so the thread goes on while they are
+	 * written. Once the headroom is gone too, the thread's open chunks are
+	 * spilled as well, then any list left, and it waits for the writer to
+	 * free chunks, with no lock held. Only if none of that frees any, the
+	 * pool goes past the budget, by a chunk per thread at most.
+	 */
+	walk_chunk *newChunk(tid_t t, bid_t p){
+		if(chunks->pressed()){
+			spillFullest(p, 8);
+		}
+		walk_chunk *c = chunks->get();
+		if(c == NULL && spillOpen(t)) c = chunks->get();
+		while(c == NULL && spillFullest(p, nblocks)) c = chunks->get();
+		if(c == NULL){
+			static bool warned = false;
+			if(!warned){
+				logstream(LOG_WARNING) << "Walk buffers exceed walkbuffer_mb, no other block could be spilled." << std::endl;
+				warned = true;
+			}
+			c = chunks->get(true);
+		}
+		if(c == NULL){
+			logstream(LOG_FATAL) << "Out of walk buffers, walkbuffer_mb is too small." << std::endl;
+			assert(false);
+		}
+		return c;
+	}
+
+	/**
+	 * Hand chunk c of block p to the block's list. Only the head of a list
+	 * may be partly filled: a full c goes behind such a head, a partial one
+	 * fills it from its end and becomes the new head if walks are left,
+	 * otherwise c is the new head. Returns c
+	 * if it was emptied that way, NULL if the list keeps it.
+	 */
+	walk_chunk *stageChunk(bid_t p, walk_chunk *c){
+		WalkBuffer &buf = pwalks[p];
+		walk_chunk *emptied = NULL;
+		buf.lock.lock();
+		walk_chunk *h = buf.head;
+		wid_t n = c->size_w;
+		__atomic_store_n(&buf.size_w, buf.size_w + n, __ATOMIC_RELAXED);
+		if(h == NULL || (n == WALK_BUFFER_SIZE && h->size_w == WALK_BUFFER_SIZE)){
+			c->next = h;
+			buf.head = c;
+		}else if(n == WALK_BUFFER_SIZE){
+			c->next = h->next;
+			h->next = c;
+		}else{
+			wid_t m = WALK_BUFFER_SIZE - h->size_w;
+			if(m > n) m = n;
+			memcpy(&h->walks[h->size_w], &c->walks[n - m], m*sizeof(WalkDataType));
+			h->size_w += m;
+			c->size_w = n - m;
+			if(c->size_w == 0){
+				emptied = c;
+			}else{
+				c->next = h;
+				buf.head = c;
+			}
+		}
+		buf.lock.unlock();
+		if(h == NULL){
+			spillable_lock.lock();
+			if(!inspillable[p]){
+				inspillable[p] = true;
+				spillable.push_back(p);
+			}
+			spillable_lock.unlock();
+		}
+		return emptied;
+	}
+
+	/* stage the open chunk of slot o, the chunk goes back to the pool if it was emptied */
+	void closeChunk(open_chunk &o){
+		if(o.c == NULL) return;
+		walk_chunk *c = o.c->size_w > 0 ? stageChunk(o.block, o.c) : o.c;
+		if(c != NULL){
+			c->next = NULL;
+			chunks->put(c);
+		}
+		o.c = NULL;
+	}
+
+	/* hand the open chunks of thread t to the spill writer, false if there were none */
+	bool spillOpen(tid_t t){
+		touched_blocks &tb = touched[t];
+		bool any = false;
+		for(unsigned i = 0; i < nopen; i++){
+			open_chunk &o = tb.open[i];
+			if(o.c == NULL) continue;
+			closeChunk(o);
+			any |= queueSpill(o.block);
+		}
+		return any;
+	}
+
+	/* walks of block p in the threads' open chunks, none of them running */
+	wid_t openWalks(bid_t p){
+		wid_t n = 0;
+		for(tid_t t = 0; t < nthreads; t++){
+			open_chunk &o = touched[t].open[p % nopen];
+			if(o.c != NULL && o.block == p) n += o.c->size_w;
+		}
+		return n;
+	}
+
+	/* all walks of block p, spilled or staged, none of the threads running */
+	wid_t stagedWalks(bid_t p){
+		return dwalknum[p] + pwalks[p].size_w + openWalks(p);
+	}
+
+	/**
+	 * Spill the walks of block p, or of the next maxcand blocks on the
+	 * spillable list the fullest if it holds more, so that spills stay
+	 * large when the budget is tight. Blocks found empty leave the list.
+	 * False if there was nothing to spill.
+	 */
+	bool spillFullest(bid_t p, size_t maxcand){
+		bid_t victim = p;
+		wid_t most = __atomic_load_n(&pwalks[p].size_w, __ATOMIC_RELAXED);
+		spillable_lock.lock();
+		for(size_t ncand = 0; ncand < maxcand && ncand < spillable.size(); ){
+			if(spillcur >= spillable.size()) spillcur = 0;
+			bid_t b = spillable[spillcur];
+			wid_t n = __atomic_load_n(&pwalks[b].size_w, __ATOMIC_RELAXED);
+			if(n == 0){
+				inspillable[b] = false;
+				spillable[spillcur] = spillable.back();
+				spillable.pop_back();
+				continue;
+			}
+			spillcur++;
+			ncand++;
+			if(n > most){
+				victim = b;
+				most = n;
+			}
+		}
+		spillable_lock.unlock();
+		return queueSpill(victim);
+	}
+
+	/* hand the list of block p to the spill writer, false if it was empty */
+	bool queueSpill(bid_t p){
+		WalkBuffer &buf = pwalks[p];
+		buf.lock.lock();
+		walk_chunk *list = buf.head;
+		if(list != NULL){
+			dwalknum[p] += buf.size_w;
+			buf.head = NULL;
+			__atomic_store_n(&buf.size_w, 0, __ATOMIC_RELAXED);
+		}
+		buf.lock.unlock();
+		if(list == NULL) return false;
+		chunks->spilling(list);
+		spill_lock.lock();
+		spill_queue.push_back(std::make_pair(p, list));
+		spill_cond.broadcast();
+		spill_lock.unlock();
+		return true;
+	}
+
+	static void *spill_loop(void *arg){
+		WalkManager *wm = (WalkManager*)arg;
+		wm->spill_lock.lock();
+		while(true){
+			while(wm->spill_queue.empty() && !wm->spill_stop)
+				wm->spill_cond.wait(wm->spill_lock);
+			if(wm->spill_queue.empty()) break;
+			std::pair<bid_t, walk_chunk*> req = wm->spill_queue.front();
+			wm->spill_queue.pop_front();
+			wm->spill_busy = true;
+			wm->spill_lock.unlock();
+			if(req.second != NULL)
+				wm->writeWalks2Disk(req.first, req.second);
+			else
+				wm->checkpointExtents();
+			wm->spill_lock.lock();
+			if(req.second == NULL) wm->ckpt_job->ready = true;
+			wm->spill_busy = false;
+			wm->spill_cond.broadcast();
+		}
+		wm->spill_lock.unlock();
+		return NULL;
+	}
+
+	/**
+	 * Write the chunks of block p to the spill store and give them back,
+	 * on the spill writer thread. With compresswalks a chunk is packed
+	 * first, unless that does not make it smaller.
+	 */
+	void writeWalks2Disk(bid_t p, walk_chunk *list){
+		metrics_entry me = m.start_time();
+		for(walk_chunk *c = list; c != NULL; c = c->next){
+			if(c->size_w == 0) continue;
+			size_t nbytes = compresswalks ? packWalks(&c->walks[0], c->size_w, packbuf) : 0;
+			if(nbytes > 0)
+				spill->append( spill_io, p, packbuf, nbytes, c->size_w, true );
+			else
+				spill->append( spill_io, p, &c->walks[0], c->size_w*sizeof(WalkDataType), c->size_w, false );
+		}
+		chunks->put(list, true);
+		m.stop_time(me, "4_writeWalks2Disk");
 	}
 
+	/* wait until the spill writer has written everything handed to it */
+	void waitSpills(){
+		m.start_time("z_w_waitSpills");
+		spill_lock.lock();
+		while(!spill_queue.empty() || spill_busy) spill_cond.wait(spill_lock);
+		spill_lock.unlock();
+		m.stop_time("z_w_waitSpills");
+	}
+
+	/* make buf hold at least n walks, what it held is dropped */
+	static void reserveWalks(WalkDataType *&buf, wid_t &sz, wid_t n){
+		if(n <= sz) return;
+		if(buf != NULL) free(buf);
+		sz = n + n/4;
+		buf = (WalkDataType*)malloc(sz*sizeof(WalkDataType));
+	}
+
+	/**
+	 * Collect the walks of block p into curwalks: the spilled ones first,
+	 * then the chunks of its list and the threads' open ones, copied in
+	 * parallel. A block with a single chunk and nothing spilled runs
+	 * straight from the chunk.
+	 */
 	wid_t getCurrentWalks(bid_t p){
 		m.start_time("3_getCurrentWalks");
-		curwalks = (WalkDataType*)malloc(walknum[p]*sizeof(WalkDataType));
-		if(dwalknum[p] > 0){
-			readWalksfromDisk(p);
-		}
-		wid_t count = dwalknum[p];
-		// logstream(LOG_INFO) << "read walks count = " << count << ", disk walknum[p] = " << dwalknum[p] << std::endl;
+		wid_t count = stagedWalks(p);
+		walk_chunk *head = pwalks[p].head;
+		pwalks[p].head = NULL;
+		pwalks[p].size_w = 0;
 		for(tid_t t = 0; t < nthreads; t++){
-			if(pwalks[t][p].size_w > 0){
-				for(wid_t w = 0; w < pwalks[t][p].size_w; w++)
-					curwalks[count+w] = pwalks[t][p][w];
-				count += pwalks[t][p].size_w;
-				// logstream(LOG_INFO) << "read walks count = " << count << ", pwalks["<<(int)t<<"]["<<p<<"].size_w = " << pwalks[t][p].size_w << std::endl;
-				pwalks[t][p].size_w = 0;
+			open_chunk &o = touched[t].open[p % nopen];
+			if(o.c == NULL || o.block != p) continue;
+			o.c->next = head;
+			head = o.c;
+			o.c = NULL;
+		}
+		if(dwalknum[p] == 0 && head != NULL && head->next == NULL){
+			curchunk = head;
+			curwalks = head->walks;
+		}else{
+			reserveWalks(walkarena, walkarena_sz, count);
+			curwalks = walkarena;
+			if(dwalknum[p] > 0){
+				waitSpills();
+				readWalksfromDisk(p);
 			}
+			gatherchunks.clear();
+			gatheroffs.clear();
+			wid_t off = dwalknum[p];
+			for(walk_chunk *c = head; c != NULL; c = c->next){
+				gatherchunks.push_back(c);
+				gatheroffs.push_back(off);
+				off += c->size_w;
+			}
+			int nchunks = gatherchunks.size();
+			#pragma omp parallel for schedule(dynamic) num_threads(nthreads) if(nchunks > 1)
+			for(int i = 0; i < nchunks; i++)
+				memcpy(curwalks + gatheroffs[i], gatherchunks[i]->walks, gatherchunks[i]->size_w*sizeof(WalkDataType));
+			chunks->put(head);
 		}
 		if (count != walknum[p]) {
 			logstream(LOG_DEBUG) << "read walks count = " << count << ", recorded walknum[p] = " << walknum[p] << ", disk walknum[p]" << dwalknum[p] << std::endl;
@@ -136,45 +654,396 @@ public:
 		return count;
 	}
 
-	void readWalksfromDisk(bid_t p){
-		m.start_time("z_w_readWalksfromDisk");
+	/* a checkpoint of this graph, block size and walk layout exists */
+	bool openCheckpoint(){
+		int f = open(walkcheckpointname(base_filename).c_str(), O_RDONLY);
+		if(f < 0){
+			logstream(LOG_WARNING) << "No checkpoint to resume from, start the walks anew." << std::endl;
+			return false;
+		}
+		bool ok = lseek(f, 0, SEEK_END) >= (off_t)sizeof(ckpt);
+		if(ok) preada(f, (char*)&ckpt, sizeof(ckpt), 0);
+		close(f);
+		if(!ok || ckpt.magic != WALK_CHECKPOINT_MAGIC || ckpt.version != WALK_CHECKPOINT_VERSION
+			|| ckpt.walk_record != WALK_RECORD || ckpt.nblocks != nblocks){
+			logstream(LOG_WARNING) << "Ignore the checkpoint of another version, walk layout or block size, start the walks anew." << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	/* put back the walk counts and the extents of the spilled walks */
+	void loadCheckpoint(){
+		int f = open(walkcheckpointname(base_filename).c_str(), O_RDONLY);
+		assert(f >= 0);
+		size_t off = ckpt.header_size;
+		preada(f, (char*)walknum, nblocks*sizeof(wid_t), off);
+		off += nblocks*sizeof(wid_t);
+		preada(f, (char*)dwalknum, nblocks*sizeof(wid_t), off);
+		off += nblocks*sizeof(wid_t);
+		preada(f, (char*)minstep, nblocks*sizeof(hid_t), off);
+		off += nblocks*sizeof(hid_t);
+		std::vector<uint64_t> nexts(nblocks);
+		preada(f, (char*)&nexts[0], nblocks*sizeof(uint64_t), off);
+		off += nblocks*sizeof(uint64_t);
+		std::vector<walk_checkpoint_extent> exts(ckpt.nextents);
+		if(ckpt.nextents > 0) preada(f, (char*)&exts[0], ckpt.nextents*sizeof(walk_checkpoint_extent), off);
+		off += ckpt.nextents*sizeof(walk_checkpoint_extent);
+		close(f);
+		size_t e = 0;
+		for(bid_t p = 0; p < nblocks; p++){
+			for(uint64_t i = 0; i < nexts[p]; i++, e++){
+				walk_extent ext;
+				ext.slot = exts[e].slot;
+				ext.nwalks = exts[e].nwalks;
+				ext.nbytes = exts[e].nbytes;
+				ext.packed = exts[e].packed;
+				spill->extentsOf(p).push_back(ext);
+			}
+		}
+		spill->restore(ckpt.nslots);
+		walksum = ckpt.walksum;
+		ckpt_state_off = off;
+		logstream(LOG_INFO) << "Resume " << walksum << " walks from the checkpoint taken after " << ckpt.blockcount << " blocks." << std::endl;
+	}
+
+	/* read the app state of the checkpoint back into the regions it was saved from */
+	void loadState(const std::vector< std::pair<void*, size_t> > &state){
+		if(state.size() != ckpt.nregions){
+			logstream(LOG_FATAL) << "The checkpoint holds " << ckpt.nregions << " regions of app state, the app registered " << state.size() << "." << std::endl;
+			assert(false);
+		}
+		int f = open(walkcheckpointname(base_filename).c_str(), O_RDONLY);
+		assert(f >= 0);
+		size_t off = ckpt_state_off;
+		for(size_t i = 0; i < state.size(); i++){
+			uint64_t nbytes;
+			preada(f, (char*)&nbytes, sizeof(nbytes), off);
+			off += sizeof(nbytes);
+			if(nbytes != state[i].second){
+				logstream(LOG_FATAL) << "App state region " << i << " is " << state[i].second << " bytes, " << nbytes << " in the checkpoint." << std::endl;
+				assert(false);
+			}
+			if(nbytes > 0) preada(f, (char*)state[i].first, nbytes, off);
+			off += nbytes;
+		}
+		close(f);
+	}
+
+	/**
+	 * Checkpoint the run between two blocks, false if the last checkpoint
+	 * is still being written. The walks in the walk buffers go to the spill
+	 * file through the spill writer; only the blocks whose lists filled
+	 * since the last checkpoint have any, the ones spilled already are not
+	 * written again. Here the counts and a copy of the app state are taken,
+	 * the checkpoint thread writes them once the spill writer is through,
+	 * to a new checkpoint that replaces the old one.
+	 */
+	bool checkpoint(uint64_t blockcount, const std::vector< std::pair<void*, size_t> > &state){
+		if(ckpt_job != NULL){
+			if(!__atomic_load_n(&ckpt_done, __ATOMIC_ACQUIRE)) return false;
+			finishCheckpoint();
+		}
+		m.start_time("z_w_checkpoint");
+		for(tid_t t = 0; t < nthreads; t++)
+			for(unsigned i = 0; i < nopen; i++)
+				closeChunk(touched[t].open[i]);
+		spillable_lock.lock();
+		std::vector<bid_t> filled(spillable);
+		spillable_lock.unlock();
+		for(size_t i = 0; i < filled.size(); i++)
+			queueSpill(filled[i]);
+
+		walk_checkpoint_job *job = new walk_checkpoint_job;
+		memset(&job->hdr, 0, sizeof(job->hdr));
+		job->hdr.magic = WALK_CHECKPOINT_MAGIC;
+		job->hdr.version = WALK_CHECKPOINT_VERSION;
+		job->hdr.header_size = sizeof(job->hdr);
+		job->hdr.walk_record = WALK_RECORD;
+		job->hdr.nregions = state.size();
+		job->hdr.nblocks = nblocks;
+		job->hdr.walksum = walksum;
+		job->hdr.blockcount = blockcount;
+		job->walknum.assign(walknum, walknum + nblocks);
+		job->dwalknum.assign(dwalknum, dwalknum + nblocks);
+		job->minstep.assign(minstep, minstep + nblocks);
+		job->state.resize(state.size());
+		for(size_t i = 0; i < state.size(); i++)
+			job->state[i].assign((char*)state[i].first, (char*)state[i].first + state[i].second);
+		job->ready = false;
+		ckpt_job = job;
+		ckpt_done = false;
+
+		spill_lock.lock();
+		spill_queue.push_back(std::make_pair(nblocks, (walk_chunk*)NULL));
+		spill_cond.broadcast();
+		spill_lock.unlock();
+		int error = pthread_create(&ckpt_thread, NULL, checkpoint_loop, this);
+		assert(!error);
+		m.stop_time("z_w_checkpoint");
+		return true;
+	}
+
+	/**
+	 * At the checkpoint mark, on the spill writer: what was spilled before
+	 * it is written, note the extents of every block and keep their slots.
+	 * The main thread reads no spilled walks back until the mark is passed.
+	 */
+	void checkpointExtents(){
+		walk_checkpoint_job *job = ckpt_job;
+		job->nexts.resize(nblocks);
+		for(bid_t p = 0; p < nblocks; p++){
+			std::vector<walk_extent> &pe = spill->extentsOf(p);
+			job->nexts[p] = pe.size();
+			for(size_t i = 0; i < pe.size(); i++){
+				walk_checkpoint_extent e;
+				e.slot = pe[i].slot;
+				e.nwalks = pe[i].nwalks;
+				e.nbytes = pe[i].nbytes;
+				e.packed = pe[i].packed;
+				job->exts.push_back(e);
+			}
+		}
+		job->hdr.nslots = spill->slots();
+		job->hdr.nextents = job->exts.size();
+		spill->pin();
+	}
 
-		std::string walksfile = walksname( base_filename, p );
-		int f = open(walksfile.c_str(),O_RDWR, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
-		if (f < 0) {
-			logstream(LOG_FATAL) << "Could not load :" << walksfile << " error: " << strerror(errno) << std::endl;
+	static void *checkpoint_loop(void *arg){
+		WalkManager *wm = (WalkManager*)arg;
+		wm->writeCheckpoint(wm->ckpt_job);
+		__atomic_store_n(&wm->ckpt_done, true, __ATOMIC_RELEASE);
+		return NULL;
+	}
+
+	/**
+	 * Write job to the checkpoint file, on the checkpoint thread. The spill
+	 * file is synced first, once the spill writer is past the checkpoint
+	 * mark; the checkpoint goes to a temporary file renamed over the old.
+	 */
+	void writeCheckpoint(walk_checkpoint_job *job){
+		spill_lock.lock();
+		while(!job->ready) spill_cond.wait(spill_lock);
+		spill_lock.unlock();
+		metrics_entry me = m.start_time();
+		fdatasync(spill->fd());
+
+		std::string fname = walkcheckpointname(base_filename);
+		std::string tmpname = fname + ".tmp";
+		int f = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+		if(f < 0){
+			logstream(LOG_FATAL) << "Could not open " << tmpname << " error: " << strerror(errno) << std::endl;
 		}
-		assert(f > 0);
-		/* read from file*/
-		preada(f, &curwalks[0], dwalknum[p]*sizeof(WalkDataType), 0);
-		/* 清空文件 */
-    	ftruncate(f,0);
+		assert(f >= 0);
+		size_t off = 0;
+		pwritea(f, (char*)&job->hdr, sizeof(job->hdr), off);
+		off += sizeof(job->hdr);
+		pwritea(f, (char*)&job->walknum[0], nblocks*sizeof(wid_t), off);
+		off += nblocks*sizeof(wid_t);
+		pwritea(f, (char*)&job->dwalknum[0], nblocks*sizeof(wid_t), off);
+		off += nblocks*sizeof(wid_t);
+		pwritea(f, (char*)&job->minstep[0], nblocks*sizeof(hid_t), off);
+		off += nblocks*sizeof(hid_t);
+		pwritea(f, (char*)&job->nexts[0], nblocks*sizeof(uint64_t), off);
+		off += nblocks*sizeof(uint64_t);
+		if(!job->exts.empty()) pwritea(f, (char*)&job->exts[0], job->exts.size()*sizeof(walk_checkpoint_extent), off);
+		off += job->exts.size()*sizeof(walk_checkpoint_extent);
+		for(size_t i = 0; i < job->state.size(); i++){
+			uint64_t nbytes = job->state[i].size();
+			pwritea(f, (char*)&nbytes, sizeof(nbytes), off);
+			off += sizeof(nbytes);
+			if(nbytes > 0) pwritea(f, &job->state[i][0], nbytes, off);
+			off += nbytes;
+		}
+		fsync(f);
 		close(f);
-		/* remove the walk file*/
-		unlink(walksfile.c_str()); 
+		bool ok = rename(tmpname.c_str(), fname.c_str()) == 0;
+		if(!ok){
+			logstream(LOG_ERROR) << "Could not replace the checkpoint " << fname << ": " << strerror(errno) << std::endl;
+		}
+		spill->unpin(ok);
+		m.stop_time(me, "z_w_checkpoint_write");
+	}
+
+	/* wait for the checkpoint being written, if any */
+	void finishCheckpoint(){
+		if(ckpt_job == NULL) return;
+		pthread_join(ckpt_thread, NULL);
+		delete ckpt_job;
+		ckpt_job = NULL;
+	}
+
+	/* the walks are done, nothing to resume */
+	void removeCheckpoint(){
+		finishCheckpoint();
+		unlink(walkcheckpointname(base_filename).c_str());
+	}
+
+	/**
+	 * Order the n walks in curwalks by current vertex with a parallel
+	 * counting sort, so walks at the same vertex run one after another and
+	 * share its beg_pos and csr lines. Each thread counts and scatters its
+	 * own share of the walks. Blocks of more than WALK_SORT_BUCKETS vertices
+	 * are bucketed by runs of neighbouring vertices, which keeps the counts
+	 * in cache and is as good for locality.
+	 */
+	void sortWalks(wid_t n, vid_t nverts){
+		if(n < 2 || nverts < 2) return;
+		m.start_time("z_w_sortWalks");
+		unsigned shift = 0;
+		while(((nverts-1) >> shift) >= WALK_SORT_BUCKETS) shift++;
+		size_t nb = ((nverts-1) >> shift) + 1;
+		int T = n < 100*(wid_t)nthreads ? 1 : nthreads;
+		if(sortcnt.size() < T*nb) sortcnt.resize(T*nb);
+		WalkDataType *sorted;
+		if(curwalks == sortbuf){
+			reserveWalks(walkarena, walkarena_sz, n);
+			sorted = walkarena;
+		}else{
+			reserveWalks(sortbuf, sortbuf_sz, n);
+			sorted = sortbuf;
+		}
+		#pragma omp parallel num_threads(T)
+		{
+			int t = omp_get_thread_num();
+			wid_t st = n*t/T, en = n*(t+1)/T;
+			wid_t *cnt = &sortcnt[t*nb];
+			memset(cnt, 0, nb*sizeof(wid_t));
+			for(wid_t i = st; i < en; i++)
+				cnt[getCurrentId(curwalks[i]) >> shift]++;
+			#pragma omp barrier
+			#pragma omp single
+			{
+				wid_t off = 0;
+				for(size_t b = 0; b < nb; b++)
+					for(int u = 0; u < T; u++){
+						wid_t c = sortcnt[u*nb + b];
+						sortcnt[u*nb + b] = off;
+						off += c;
+					}
+			}
+			for(wid_t i = st; i < en; i++)
+				sorted[cnt[getCurrentId(curwalks[i]) >> shift]++] = curwalks[i];
+		}
+		curwalks = sorted;
+		m.stop_time("z_w_sortWalks");
+	}
 
+	/**
+	 * Read the spilled walks of block p into curwalks. Raw chunks are read
+	 * in place, packed ones into unpackbuf and decoded after, each of them
+	 * comes back ordered by current vertex.
+	 */
+	void readWalksfromDisk(bid_t p){
+		m.start_time("z_w_readWalksfromDisk");
+		std::vector<walk_extent> &exts = spill->extentsOf(p);
+		size_t packed = 0;
+		for(size_t i = 0; i < exts.size(); i++)
+			if(exts[i].packed) packed += exts[i].nbytes;
+		if(packed > unpackbuf_sz){
+			if(unpackbuf != NULL) free(unpackbuf);
+			unpackbuf = (unsigned char*)malloc(packed);
+			unpackbuf_sz = packed;
+		}
+		wid_t count = 0;
+		size_t off = 0;
+		for(size_t i = 0; i < exts.size(); i++){
+			if(exts[i].packed){
+				wio->queue_read(spill->fd(), unpackbuf + off, exts[i].nbytes, spill->offset(exts[i]));
+				off += exts[i].nbytes;
+			}else{
+				wio->queue_read(spill->fd(), curwalks + count, exts[i].nbytes, spill->offset(exts[i]));
+			}
+			count += exts[i].nwalks;
+		}
+		wio->submit();
+		assert(count == dwalknum[p]);
+		if(packed > 0){
+			m.start_time("z_w_unpackWalks");
+			count = 0;
+			off = 0;
+			for(size_t i = 0; i < exts.size(); i++){
+				if(exts[i].packed){
+					unpackWalks(unpackbuf + off, exts[i].nwalks, curwalks + count);
+					off += exts[i].nbytes;
+				}
+				count += exts[i].nwalks;
+			}
+			m.stop_time("z_w_unpackWalks");
+		}
+		spill->release(p);
 		m.stop_time("z_w_readWalksfromDisk");
 	}
 
+	/**
+	 * The apps set walknum and minstep of the walks they start themselves,
+	 * forget the blocks they touched and rank all blocks anew.
+	 */
+	void walksStarted(){
+		for(tid_t t = 0; t < nthreads; t++){
+			std::vector<bid_t> &tb = touched[t].blocks;
+			for(size_t i = 0; i < tb.size(); i++)
+				ismodified[tb[i]] = false;
+			tb.clear();
+		}
+		indexBlocks();
+	}
+
+	hid_t stepKey(bid_t b){
+		return walknum[b] > 0 ? minstep[b] : (hid_t)-1;
+	}
+
+	float weightKey(bid_t b){
+		return walknum[b] > 0 ? (float)walknum[b]/minstep[b] : 0;
+	}
+
+	void indexBlock(bid_t b){
+		walkheap.update(b, walknum[b]);
+		stepheap.update(b, stepKey(b));
+		weightheap.update(b, weightKey(b));
+	}
+
+	void indexBlocks(){
+		std::vector<hid_t> steps(nblocks);
+		std::vector<float> weights(nblocks);
+		for(bid_t b = 0; b < nblocks; b++){
+			steps[b] = stepKey(b);
+			weights[b] = weightKey(b);
+		}
+		walkheap.build(nblocks, walknum);
+		stepheap.build(nblocks, &steps[0]);
+		weightheap.build(nblocks, &weights[0]);
+	}
+
+	/**
+	 * Account for the walks moved while block p ran. Only the blocks in the
+	 * threads' touched lists are recounted, so the cost follows the blocks
+	 * the walks went to rather than nblocks.
+	 */
 	void updateWalkNum(bid_t p){
 
 		m.start_time("6_updateWalkNum");
 		wid_t forwardWalks = 0;
-		for(bid_t b = 0; b < nblocks; b++){
-			if(ismodified[b] && b != p){
+		recounted.clear();
+		for(tid_t t = 0; t < nthreads; t++){
+			std::vector<bid_t> &tb = touched[t].blocks;
+			for(size_t i = 0; i < tb.size(); i++){
+				bid_t b = tb[i];
 				ismodified[b] = false;
-				wid_t newwalknum = 0;
-				newwalknum = dwalknum[b];
-				for(tid_t t = 0; t < nthreads; t++){
-					newwalknum += pwalks[t][b].size_w;
-				}
-				if(newwalknum < walknum[b]){
-					logstream(LOG_DEBUG) <<" b = " << b <<", newwalknum = " << newwalknum << ", walknum[b] = " << walknum[b] << std::endl;
-					assert(false);
-				}
-				forwardWalks += newwalknum - walknum[b];
-				walknum[b] = newwalknum;
+				if(b != p) recounted.push_back(b);
+			}
+			tb.clear();
+		}
+		for(size_t i = 0; i < recounted.size(); i++){
+			bid_t b = recounted[i];
+			wid_t newwalknum = stagedWalks(b);
+			if(newwalknum < walknum[b]){
+				logstream(LOG_DEBUG) <<" b = " << b <<", newwalknum = " << newwalknum << ", walknum[b] = " << walknum[b] << std::endl;
+				assert(false);
 			}
+			forwardWalks += newwalknum - walknum[b];
+			walknum[b] = newwalknum;
+			indexBlock(b);
 		}
 
 		// logstream(LOG_DEBUG) <<"Total " << walksum << " walks, Updated " << walknum[p] << " walks, and forward " << forwardWalks << " walks. " << std::endl;
@@ -183,8 +1052,13 @@ public:
 		walksum += forwardWalks;
 		walksum -= walknum[p];
 		walknum[p] = 0;
-		minstep[p] = 0xffff;
-		free(curwalks);
+		minstep[p] = (hid_t)-1;
+		indexBlock(p);
+		recounted.push_back(p);
+		if(curchunk != NULL){
+			chunks->put(curchunk);
+			curchunk = NULL;
+		}
 		curwalks = NULL;
 		m.stop_time("z_w_clear_curwalks");
 
@@ -202,39 +1076,38 @@ public:
      }
 
      bid_t blockWithMaxWalks(){
-		wid_t maxw = 0, maxp = 0;
-		for(bid_t p = 0; p < nblocks; p++) {
-			if( maxw < walknum[p] ){
-				maxw = walknum[p];
-				maxp = p;
-			}
-	   	}
-		return maxp;
+		return walkheap.top();
      }
 
      bid_t blockWithMinStep(){
-		hid_t mins = 0xffff, minp = 0;
-		for(bid_t p = 0; p < nblocks; p++) {
-			if( mins > minstep[p] ){
-				mins = minstep[p];
-				minp = p;
-			}
-	   	}
+		bid_t minp = stepheap.top();
 		if(walknum[minp] > 0)
 			return minp;
 		return blockWithMaxWalks();
      }
 
      bid_t blockWithMaxWeight(){
-		float maxwt = 0;
-		bid_t maxp = 0;
-		for(bid_t p = 0; p < nblocks; p++) {
-			if(  maxwt < (float)walknum[p]/minstep[p] ){
-				maxwt = (float)walknum[p]/minstep[p];
-				maxp = p;
-			}
-	   	}
-		return maxp;
+		return weightheap.top();
+     }
+
+     /**
+      * Guess which blocks chooseBlock will pick after exec_block, so the engine
+      * can load them ahead of time. The block with most walks comes first as it
+      * is the common choice, then the min-step block, then the runners-up.
+      */
+     bid_t predictBlocks(bid_t exec_block, bid_t k, bid_t *pred){
+		std::vector<bid_t> top(k);
+		bid_t ntop = walkheap.best(k, exec_block, &top[0]);
+		while(ntop > 0 && walknum[top[ntop-1]] == 0) ntop--;
+		bid_t minp = nblocks;
+		if(stepheap.best(1, exec_block, &minp) == 0 || walknum[minp] == 0) minp = nblocks;
+		bid_t npred = 0;
+		if(ntop > 0) pred[npred++] = top[0];
+		if(npred < k && minp < nblocks && (npred == 0 || minp != pred[0])) pred[npred++] = minp;
+		for(bid_t i = 1; i < ntop && npred < k; i++){
+			if(top[i] != minp) pred[npred++] = top[i];
+		}
+		return npred;
      }
 
      bid_t blockWithRandom(){
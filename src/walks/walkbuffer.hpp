@@ -3,40 +3,144 @@
 
 
 #include <cstring>
+#include <vector>
 #include "api/datatype.hpp"
+#include "api/pthread_tools.hpp"
+#include "util/hugepage.hpp"
 
-class WalkBuffer{
-
-public:
-	bool malloced;
+/* a fixed size piece of a block's staged walks */
+struct walk_chunk {
+	walk_chunk *next;
 	wid_t size_w;
-	WalkDataType *walks;
+	WalkDataType walks[WALK_BUFFER_SIZE];
+};
+
+/**
+ * Chunks shared by all walk buffers, at most budget bytes of them. They are
+ * allocated on first use and recycled after, on huge pages the budget is
+ * reserved as one region up front and only backed as chunks are touched.
+ * The last headroom chunks are kept for the buffers that swap in while
+ * full ones are being written out; pressed() tells when to start spilling.
+ * Past the budget at most maxover more chunks are ever allocated.
+ */
+class walk_chunk_pool {
+	size_t maxchunks, nchunks;
+	size_t headroom;
+	size_t maxover;
+	walk_chunk *freelist;
+	size_t nfree;
+	size_t nspilling; //chunks handed to the spill writer
+	std::vector<walk_chunk*> malloced;
+	char *region;
+	size_t region_sz;
+	mutex lock;
+	conditional freed;
+
+	/* pop a free or new chunk, lock held */
+	walk_chunk *take(bool over){
+		walk_chunk *c = NULL;
+		if(freelist != NULL){
+			c = freelist;
+			freelist = c->next;
+			__atomic_store_n(&nfree, nfree - 1, __ATOMIC_RELAXED);
+		}else if(nchunks < maxchunks && region != NULL){
+			c = (walk_chunk*)(region + nchunks*sizeof(walk_chunk));
+			__atomic_store_n(&nchunks, nchunks + 1, __ATOMIC_RELAXED);
+		}else if(nchunks < maxchunks || (over && nchunks < maxchunks + maxover)){
+			c = (walk_chunk*)malloc(sizeof(walk_chunk));
+			malloced.push_back(c);
+			__atomic_store_n(&nchunks, nchunks + 1, __ATOMIC_RELAXED);
+		}
+		if(c != NULL){
+			c->next = NULL;
+			c->size_w = 0;
+		}
+		return c;
+	}
 
 public:
-	WalkBuffer(){
-		size_w = 0;
-		malloced = false;
-		// walks = (WalkDataType*)malloc(WALK_BUFFER_SIZE*sizeof(WalkDataType));
+	walk_chunk_pool(size_t budget, size_t _headroom, size_t _maxover, hugepage_t huge) : nchunks(0), freelist(NULL), nfree(0), nspilling(0), region(NULL), region_sz(0) {
+		maxchunks = budget / sizeof(walk_chunk);
+		if(maxchunks == 0) maxchunks = 1;
+		headroom = _headroom < maxchunks/2 ? _headroom : maxchunks/2;
+		maxover = _maxover;
+		if(huge != HUGEPAGE_NONE)
+			region = (char*)hugepage_alloc(maxchunks*sizeof(walk_chunk), huge, &region_sz);
+	}
+
+	~walk_chunk_pool(){
+		for(size_t i = 0; i < malloced.size(); i++)
+			free(malloced[i]);
+		if(region != NULL) hugepage_free(region, region_sz);
 	}
 
-	~WalkBuffer(){
-		if(size_w > 0 && walks != NULL){
-			free(walks);
+	/**
+	 * A free chunk. Once the budget is spent, wait for the spill writer to
+	 * give chunks back if it holds any, else return NULL; with over set,
+	 * one of the maxover extra chunks if any is left.
+	 */
+	walk_chunk *get(bool over = false){
+		lock.lock();
+		walk_chunk *c = take(over);
+		while(c == NULL && nspilling > 0){
+			freed.wait(lock);
+			c = take(over);
 		}
+		lock.unlock();
+		return c;
 	}
 
-    WalkDataType& operator[] (int i){
-        return walks[i];
-    }
+	/* less than headroom chunks are left, read without the lock as a hint */
+	bool pressed(){
+		size_t used = __atomic_load_n(&nchunks, __ATOMIC_RELAXED) - __atomic_load_n(&nfree, __ATOMIC_RELAXED);
+		return used + headroom >= maxchunks;
+	}
+
+	/* the list of chunks starting at c goes to the spill writer */
+	void spilling(walk_chunk *c){
+		size_t n = 0;
+		for(; c != NULL; c = c->next) n++;
+		lock.lock();
+		nspilling += n;
+		lock.unlock();
+	}
 
-	void push_back(WalkDataType w){
-		if(!malloced){
-			assert(size_w == 0);
-			walks = (WalkDataType*)malloc(WALK_BUFFER_SIZE*sizeof(WalkDataType));
-			malloced = true;
+	/* give back the list of chunks starting at c, spilled if it came from the writer */
+	void put(walk_chunk *c, bool spilled = false){
+		if(c == NULL) return;
+		size_t n = 1;
+		walk_chunk *last = c;
+		while(last->next != NULL){
+			last = last->next;
+			n++;
 		}
-        walks[size_w++] = w;
+		lock.lock();
+		last->next = freelist;
+		freelist = c;
+		__atomic_store_n(&nfree, nfree + n, __ATOMIC_RELAXED);
+		if(spilled) nspilling -= n;
+		freed.broadcast();
+		lock.unlock();
+	}
+};
+
+/**
+ * Walks staged in memory for one block: the list of chunks the threads
+ * have handed in, under the lock, of which only the head is partly filled. size_w is also read
+ * without it, as a hint, so it is stored atomically.
+ */
+class WalkBuffer{
+
+public:
+	spinlock lock;
+	wid_t size_w; //walks in all chunks
+	walk_chunk *head;
+
+public:
+	WalkBuffer(){
+		size_w = 0;
+		head = NULL;
 	}
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,39 @@
+#ifndef DEF_WALK_CHECKPOINT
+#define DEF_WALK_CHECKPOINT
+
+#include <stdint.h>
+
+#define WALK_CHECKPOINT_MAGIC 0x54504b434b4c5747ULL // "GWLKCKPT"
+#define WALK_CHECKPOINT_VERSION 1
+
+/**
+ * Walk checkpoint, walks/checkpoint. It holds the walk counts and where the
+ * walks of each block are in the spill file, which the checkpoint pins, so
+ * both together are the state of the run between two blocks. The header is
+ * followed by wid_t walknum[nblocks], wid_t dwalknum[nblocks], hid_t
+ * minstep[nblocks], uint64_t nextents[nblocks], the walk_checkpoint_extent
+ * of all blocks in block order and, for each of the nregions regions of app
+ * state, uint64_t nbytes followed by its bytes.
+ */
+struct walk_checkpoint_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t walk_record; //WALK_RECORD the walks were written with
+    uint32_t nregions;
+    uint64_t nblocks;
+    uint64_t walksum;
+    uint64_t nslots; //of the spill file
+    uint64_t nextents;
+    uint64_t blockcount; //blocks executed before the checkpoint
+    uint64_t reserved[2];
+};
+
+struct walk_checkpoint_extent {
+    uint64_t slot;
+    uint64_t nwalks;
+    uint32_t nbytes;
+    uint32_t packed;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef DEF_WALK_KERNEL
+#define DEF_WALK_KERNEL
+
+#include <omp.h>
+
+#include "api/datatype.hpp"
+#include "walks/walk.hpp"
+#include "walks/randomwalk.hpp"
+#include "walks/interleave.hpp"
+
+/**
+ * Step loop of the first order walks, compiled for one app. App derives
+ * from walk_kernel<App, Rule>, and Rule, a RandomWalk with live() and
+ * offEdges(), is the stop condition. The loop calls App's updateInfo and
+ * the rule through their static types, so with App declared final nothing
+ * in a hop is virtual, the visit inlines and an empty one compiles away;
+ * the engine's run is instantiated for App as well. The classes the apps
+ * used to derive from, RandomWalkwithJump and the like, are this kernel
+ * with App the class itself: apps deriving from them still have updateInfo
+ * called through the vtable.
+ */
+template <class App, class Rule>
+class walk_kernel : public Rule {
+
+public:
+
+    inline App &app(){
+        return *static_cast<App*>(this);
+    }
+
+    void updateByWalk(WalkDataType walk, wid_t walkid, bid_t exec_block, eid_t *&beg_pos, vid_t *&csr, WalkManager &walk_manager ){
+        App &a = app();
+        tid_t threadid = omp_get_thread_num();
+        walk_rng &rnd = a.rng[threadid];
+        WalkDataType nowWalk = walk;
+        vid_t sourId = walk_manager.getSourceId(nowWalk);
+        vid_t dstId = walk_manager.getCurrentId(nowWalk) + a.blocks[exec_block];
+        hid_t hop = walk_manager.getHop(nowWalk);
+        vid_t *adj;
+        eid_t outd;
+        alias_entry *tab;
+        while (a.live(hop) && a.adjacency(dstId, exec_block, beg_pos, csr, adj, outd, tab)){
+            a.updateInfo(sourId, dstId, threadid, hop);
+            if (outd > 0 && !rnd.chance(a.restart) ){
+                dstId = a.pickEdge(adj, outd, tab, rnd);
+            }else if(!a.offEdges(dstId, sourId, rnd)){
+                return;
+            }
+            hop++;
+            walk_manager.nextHop(nowWalk);
+        }
+        if( a.live(hop) ){
+            bid_t p = a.getblock( dstId );
+            if(p>=a.nblocks) return;
+            walk_manager.moveWalk(nowWalk, p, threadid, dstId - a.blocks[p]);
+            walk_manager.setMinStep( p, hop );
+        }
+    }
+
+    void updateByWalks(WalkDataType *walks, wid_t n, wid_t first, bid_t exec_block, eid_t *beg_pos, vid_t *csr, WalkManager &walk_manager){
+        if(this->interleave == 0){
+            for(wid_t i = 0; i < n; i++)
+                walk_kernel::updateByWalk(walks[i], first + i, exec_block, beg_pos, csr, walk_manager);
+            return;
+        }
+        interleaveWalks(app(), walks, n, exec_block, beg_pos, csr, walk_manager, this->interleave);
+    }
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef DEF_WALK_SPILL
+#define DEF_WALK_SPILL
+
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "api/datatype.hpp"
+#include "api/iobackend.hpp"
+#include "api/pthread_tools.hpp"
+#include "logger/logger.hpp"
+
+#define WALK_SPILL_SLOT (WALK_BUFFER_SIZE * sizeof(WalkDataType)) // a chunk of walks
+#define WALK_SPILL_GROW (64UL * 1024 * 1024) // bytes preallocated at a time
+
+/* walks of a block in one slot of the spill file */
+struct walk_extent {
+	size_t slot;
+	wid_t nwalks;
+	uint32_t nbytes;
+	bool packed; //in the compressed walk format, else raw WalkDataType
+};
+
+/**
+ * Log structured store for the walks spilled out of the walk buffers. All
+ * blocks share one file, kept open for the whole run and preallocated in
+ * WALK_SPILL_GROW steps. It is cut into chunk sized slots: a spilled chunk
+ * takes a free slot, and the slots of a block are freed for reuse once its
+ * walks are read back, so the file stops growing after the first rounds
+ * and no file is created, truncated or removed per spill. The store only
+ * keeps bytes, how the walks are encoded is up to the WalkManager.
+ * pin() keeps the slots in use at a checkpoint from being reused until the
+ * next one replaces it, so the checkpoint can point into the file; while a
+ * checkpoint is written, the slots of both are kept.
+ */
+class walk_spill_store {
+	std::string fname;
+	int f;
+	size_t nslots; //slots handed out so far
+	size_t reserved; //bytes preallocated
+	std::vector<size_t> freeslots;
+	std::vector<char> pinned; //slots of the last checkpoint (1) and of the one being written (2)
+	std::vector<size_t> deferred; //released pinned slots, free once no checkpoint refers to them
+	std::vector<walk_extent> *extents; //of each block
+	bid_t nblocks;
+	mutex lock;
+
+	size_t newSlot() {
+		lock.lock();
+		size_t slot;
+		if (!freeslots.empty()) {
+			slot = freeslots.back();
+			freeslots.pop_back();
+		} else {
+			slot = nslots++;
+			if (nslots * WALK_SPILL_SLOT > reserved) {
+				if (fallocate(f, 0, reserved, WALK_SPILL_GROW) != 0) {
+					static bool warned = false;
+					if (!warned) {
+						logstream(LOG_WARNING) << "Could not preallocate " << fname << ": " << strerror(errno) << std::endl;
+						warned = true;
+					}
+				}
+				reserved += WALK_SPILL_GROW;
+			}
+		}
+		lock.unlock();
+		return slot;
+	}
+
+public:
+	/* keep the file of an earlier run, to resume from its checkpoint */
+	walk_spill_store(std::string _fname, bid_t _nblocks, bool keep = false) : fname(_fname), nslots(0), reserved(0), nblocks(_nblocks) {
+		f = open(fname.c_str(), O_RDWR | O_CREAT | (keep ? 0 : O_TRUNC), S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+		if (f < 0) {
+			logstream(LOG_FATAL) << "Could not open :" << fname << " error: " << strerror(errno) << std::endl;
+		}
+		assert(f >= 0);
+		extents = new std::vector<walk_extent>[nblocks];
+	}
+
+	~walk_spill_store() {
+		delete [] extents;
+		close(f);
+		unlink(fname.c_str());
+	}
+
+	int fd() {
+		return f;
+	}
+
+	/* spill nbytes, at most a slot, holding nwalks walks of block p; the caller owns p */
+	void append(io_backend *io, bid_t p, const void *buf, size_t nbytes, wid_t nwalks, bool packed) {
+		assert(nbytes <= WALK_SPILL_SLOT);
+		walk_extent ext;
+		ext.slot = newSlot();
+		ext.nwalks = nwalks;
+		ext.nbytes = nbytes;
+		ext.packed = packed;
+		io->write(f, buf, nbytes, ext.slot * WALK_SPILL_SLOT);
+		extents[p].push_back(ext);
+	}
+
+	/* spilled walks of block p, in the order they were appended */
+	std::vector<walk_extent> &extentsOf(bid_t p) {
+		return extents[p];
+	}
+
+	size_t offset(const walk_extent &ext) {
+		return ext.slot * WALK_SPILL_SLOT;
+	}
+
+	/* the walks of block p have been read back, free their slots */
+	void release(bid_t p) {
+		std::vector<walk_extent> &exts = extents[p];
+		lock.lock();
+		for (size_t i = 0; i < exts.size(); i++) {
+			if (exts[i].slot < pinned.size() && pinned[exts[i].slot])
+				deferred.push_back(exts[i].slot);
+			else
+				freeslots.push_back(exts[i].slot);
+		}
+		lock.unlock();
+		exts.clear();
+	}
+
+	size_t slots() {
+		return nslots;
+	}
+
+	/* a checkpoint being written refers to the slots in use, none of the appends are pending */
+	void pin() {
+		lock.lock();
+		pinned.resize(nslots, 0);
+		for (bid_t p = 0; p < nblocks; p++)
+			for (size_t i = 0; i < extents[p].size(); i++)
+				pinned[extents[p][i].slot] |= 2;
+		lock.unlock();
+	}
+
+	/* the checkpoint pinned last replaced the one before if ok, else it was given up; free the slots neither refers to */
+	void unpin(bool ok) {
+		lock.lock();
+		for (size_t slot = 0; slot < pinned.size(); slot++)
+			pinned[slot] = ok ? pinned[slot] >> 1 : pinned[slot] & 1;
+		size_t n = 0;
+		for (size_t i = 0; i < deferred.size(); i++) {
+			if (pinned[deferred[i]])
+				deferred[n++] = deferred[i];
+			else
+				freeslots.push_back(deferred[i]);
+		}
+		deferred.resize(n);
+		lock.unlock();
+	}
+
+	/* the extents of a checkpoint were put back, the file has _nslots slots */
+	void restore(size_t _nslots) {
+		nslots = _nslots;
+		reserved = lseek(f, 0, SEEK_END);
+		if (reserved < nslots * WALK_SPILL_SLOT) reserved = nslots * WALK_SPILL_SLOT;
+		pin();
+		unpin(true);
+		freeslots.clear();
+		for (size_t slot = 0; slot < nslots; slot++)
+			if (!pinned[slot]) freeslots.push_back(slot);
+	}
+};
+
+#endif